@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Console benchmarks selected from the command line. They report timings
+// instead of entering the render loop; the GL ones need a current context.
+class Benchmark
+{
+public:
+	// CPU mip chains against glGenerateMipmap for every image in directory, upscaled to 4K and 8K
+	static void MipGeneration(const std::string& directory);
+	// Scalar against SIMD frustum culling of random boxes, single-threaded and over the thread pool
+	static void FrustumCulling(size_t boxCount);
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Camera.h"
+
+// Axis-aligned boxes as structure of arrays. The arrays are padded to a
+// multiple of kBlockSize with empty boxes so the SIMD loops have no tail.
+struct BoundsArray
+{
+	static const size_t kBlockSize = 8;
+
+	std::vector<float> minX, minY, minZ;
+	std::vector<float> maxX, maxY, maxZ;
+	size_t count = 0;
+
+	void Clear();
+	void Reserve(size_t capacity);
+	void Add(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+	inline size_t GetPaddedCount() const { return minX.size(); }
+};
+
+// Tests boxes against the six frustum planes 8 (AVX) or 4 (SSE) at a time.
+// Each plane only looks at the box corner furthest along its normal, which
+// is picked once per plane since every lane shares it. Large arrays are
+// split over the thread pool.
+class FrustumCuller
+{
+public:
+	static const size_t kParallelThreshold = 32768;
+
+	// visible[i] is set to 1 when box i may intersect the frustum and 0 when it
+	// lies fully outside one plane. visible needs room for GetPaddedCount() entries.
+	static void Cull(const Frustum& frustum, const BoundsArray& bounds, uint8_t* visible, bool parallel = true);
+
+	static const char* GetInstructionSet();
+
+	// Forces the scalar loop, for benchmarking
+	static void SetSimdEnabled(bool enabled);
+private:
+	static bool s_SimdEnabled;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+// Shared vertex and index buffers for every mesh of a model with one vertex
+// layout and index type, described by a single VAO. Meshes are appended as
+// they stream in; the buffers double when full and the old contents are
+// copied over on the GPU. Draws address a mesh by its first vertex and the
+// byte offset of its first index.
+class GeometryArena
+{
+public:
+	GeometryArena(bool compact, GLenum indexType);
+	~GeometryArena();
+
+	GeometryArena(const GeometryArena&) = delete;
+	GeometryArena& operator=(const GeometryArena&) = delete;
+
+	// Copies the arrays in. indexData holds indices of the arena's index type.
+	void Add(const void* vertexData, size_t vertexCount, const void* indexData, size_t indexCount,
+		size_t& firstVertex, size_t& indexByteOffset);
+
+	inline unsigned int GetVertexArray() const { return m_VAO; }
+	// Per-instance transforms, bound to the VAO's instance attributes
+	inline unsigned int GetInstanceBuffer() const { return m_InstanceVBO; }
+	inline bool IsCompact() const { return m_Compact; }
+	inline GLenum GetIndexType() const { return m_IndexType; }
+	// Bytes of vertex and index data in use
+	size_t GetBytes() const;
+private:
+	bool m_Compact;
+	GLenum m_IndexType;
+	unsigned int m_VAO, m_VBO, m_EBO, m_InstanceVBO;
+	size_t m_VertexCount, m_VertexCapacity;
+	size_t m_IndexCount, m_IndexCapacity;
+
+	size_t GetVertexSize() const;
+	size_t GetIndexSize() const;
+	void SetupVertexArray();
+	static void Grow(unsigned int& buffer, size_t usedBytes, size_t newBytes);
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <assimp/Importer.hpp>
+
+#include <string>
+
+// Assimp post-processing chosen by name and trimmed to the vertex attributes
+// the shader reads, so nothing that is thrown away later gets computed.
+//
+//   fast-preview  triangulate and fill in missing normals; vertices stay unshared
+//   balanced      also welds vertices and drops points/lines
+//   max-optimize  also merges meshes, flattens the node graph and removes degenerates
+struct ImportProfile
+{
+	std::string name;
+	unsigned int flags = 0;
+	int removeComponents = 0;
+	int removePrimitives = 0;
+
+	static bool Resolve(const std::string& name, unsigned int vertexAttributes, ImportProfile& out);
+	static const char* GetNames();
+
+	// Sets the importer properties the flags rely on
+	void Configure(Assimp::Importer& importer) const;
+};
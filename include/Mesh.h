@@ -6,7 +6,11 @@
 #include <string>
 #include <vector>
 
+#include "Camera.h"
+#include "Meshlet.h"
+#include "MeshOptimizer.h"
 #include "Shader.h"
+#include "UniformBuffer.h"
 
 struct Vertex
 {
@@ -15,6 +19,15 @@ struct Vertex
 	glm::vec2 TexCoords;
 };
 
+// Vertex fields by shader attribute location, as bits of a mask
+enum VertexAttribute
+{
+	VERTEX_ATTRIBUTE_POSITION = 1 << 0,
+	VERTEX_ATTRIBUTE_NORMAL = 1 << 1,
+	VERTEX_ATTRIBUTE_TEXCOORD = 1 << 2,
+	VERTEX_ATTRIBUTE_ALL = VERTEX_ATTRIBUTE_POSITION | VERTEX_ATTRIBUTE_NORMAL | VERTEX_ATTRIBUTE_TEXCOORD
+};
+
 struct Texture
 {
 	unsigned int id;
@@ -22,17 +35,157 @@ struct Texture
 	std::string path;
 };
 
+struct TextureRef
+{
+	std::string type;
+	std::string path;
+};
+
+// One level of detail as a slice of the index array. error is the largest
+// object-space distance between this level and the full mesh.
+struct MeshLod
+{
+	size_t indexOffset;
+	size_t indexCount;
+	float error;
+};
+
+// CPU-side mesh produced by the loaders on worker threads, before upload
+struct MeshData
+{
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	std::vector<TextureRef> textures;
+	// Level 0 is the full mesh; coarser levels follow it in indices
+	std::vector<MeshLod> lods;
+	// VertexAttribute bits the source actually provided; missing ones are zero-filled
+	unsigned int attributes = VERTEX_ATTRIBUTE_ALL;
+	double convertMs = 0.0;
+	VertexCacheStats cacheBefore, cacheAfter;
+};
+
+// One draw of a packed mesh; offset and count are in indices, which are relative to baseVertex
+struct DrawRange
+{
+	size_t indexOffset;
+	size_t indexCount;
+	int baseVertex;
+};
+
+// The draw ranges and meshlets making up one level of detail of a packed mesh
+struct DrawLod
+{
+	size_t firstRange;
+	size_t rangeCount;
+	size_t firstMeshlet;
+	size_t meshletCount;
+	float error;
+};
+
+// What a draw needs to know about the camera to pick levels of detail
+struct ViewInfo
+{
+	glm::mat4 model;
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec3 cameraPosition;
+	float viewportHeight;
+};
+
+// Index runs for one glMultiDrawElementsBaseVertex, gathered from one or
+// more meshes sharing a VAO
+struct DrawList
+{
+	std::vector<GLsizei> counts;
+	std::vector<const void*> offsets;
+	std::vector<GLint> baseVertices;
+	size_t end = 0;
+
+	inline void Clear() { counts.clear(); offsets.clear(); baseVertices.clear(); end = 0; }
+	inline bool IsEmpty() const { return counts.empty(); }
+	// Extends the last run instead when this one continues it
+	void Add(size_t indexCount, size_t byteOffset, size_t indexSize, GLint baseVertex);
+};
+
+struct PackedMesh;
+class GeometryArena;
+
 class Mesh
 {
 public:
 	std::vector<Vertex> vertices;
 	std::vector<unsigned int> indices;
+	std::vector<MeshLod> lods;
 	std::vector<Texture> textures;
 
 	Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures);
+	// Keeps the CPU arrays but uploads an already packed copy of them. With an
+	// arena, the data is appended to its shared buffers instead of new ones.
+	Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<MeshLod> lods, std::vector<Texture> textures,
+		const PackedMesh& packed, GeometryArena* arena = nullptr);
+	// Uploads straight from caller-owned memory (e.g. a mapped cache entry) without keeping a CPU copy
+	Mesh(const PackedMesh& packed, std::vector<Texture> textures, GeometryArena* arena = nullptr);
 
+	// Picks the coarsest level whose error projects to at most pixelError
+	// pixels, for a copy currently drawn at level current. Moving to a coarser
+	// level needs some margin, so a mesh sitting right at a switch distance
+	// does not flicker between two levels.
+	size_t SelectLod(const ViewInfo& view, float pixelError, size_t current) const;
+	// Level used by the non-instanced draws
+	inline void SetLod(size_t lod) { currentLod = lod; }
 	void Draw(Shader& shader);
+	// Draws only the meshlets of the current level that are inside the frustum
+	// and not entirely back-facing. Both are given in object space.
+	void Draw(Shader& shader, const Frustum& frustum, const glm::vec3& cameraPosition);
+	// Draws count copies, each placed by the bound object transform times its
+	// own and drawn at its own level, with one instanced draw per level and range
+	void DrawInstanced(Shader& shader, const ObjectData* instances, const uint8_t* lods, size_t count);
+
+	// Appends the current level's ranges to list
+	void Gather(DrawList& list);
+	// Appends the current level's meshlets that pass the frustum test and, with
+	// face culling on, the cone test
+	void Gather(DrawList& list, const Frustum& frustum, const glm::vec3& cameraPosition);
+
+	// Lower-level pieces of the draws above, for callers that track GL state
+	// themselves. The Submit calls expect this mesh's VAO to be bound.
+	void BindMaterial(Shader& shader);
+	// Runs gathered from meshes sharing this mesh's VAO and index type, as one multi-draw
+	void SubmitRuns(const GLsizei* counts, const void* const* offsets, const GLint* baseVertices, size_t runCount);
+	// Expects "instanced" to be set
+	void SubmitInstances(const ObjectData* instances, const uint8_t* lods, size_t count);
+
+	inline size_t GetLodCount() const { return lodLevels.size(); }
+	inline size_t GetCurrentLod() const { return currentLod; }
+	size_t GetTriangleCount(size_t lod) const;
+	// Bytes of vertex and index data on the GPU
+	inline size_t GetGpuBytes() const { return gpuBytes; }
+	inline unsigned int GetVertexArray() const { return VAO; }
+	inline bool IsCompact() const { return compact; }
+	inline unsigned int GetVertexAttributes() const { return attributes; }
+	// ShaderFeature bits of the variant this mesh draws with, chosen at load time
+	inline unsigned int GetShaderFeatures() const { return shaderFeatures; }
 private:
 	unsigned int VAO, VBO, EBO;
-	void InitMesh();
+	GLenum indexType;
+	std::vector<DrawRange> ranges;
+	std::vector<DrawLod> lodLevels;
+	std::vector<Meshlet> meshlets;
+	// Where the mesh starts in its buffers, which may be shared with other meshes
+	size_t firstVertex, indexByteOffset;
+	DrawList drawList;
+	// Per-instance transforms, grouped by level before upload
+	unsigned int instanceVBO;
+	std::vector<ObjectData> instanceTransforms;
+	std::vector<size_t> instanceLodStarts, instanceLodCursor;
+	size_t currentLod;
+	glm::vec3 boundsCenter;
+	float boundsRadius;
+	bool compact;
+	unsigned int attributes, shaderFeatures;
+	glm::vec3 positionOffset, positionScale;
+	size_t gpuBytes;
+	// Hashed sampler name of each texture
+	std::vector<uint32_t> textureUniforms;
+	void InitMesh(const PackedMesh& packed, GeometryArena* arena);
 };
\ No newline at end of file
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "Mesh.h"
+#include "SceneGraph.h"
+
+// Versioned on-disk copy of a Model's node hierarchy and its final
+// vertex/index arrays, LOD and texture tables. Entries are keyed by source path, size, mtime and import flags and
+// are read back through a memory mapping, so the arrays can be handed to
+// glBufferData without any parsing.
+class MeshCache
+{
+public:
+	struct CachedMesh
+	{
+		const Vertex* vertices;
+		size_t vertexCount;
+		const unsigned int* indices;
+		size_t indexCount;
+		std::vector<MeshLod> lods;
+		std::vector<TextureRef> textures;
+		unsigned int attributes;
+		// Scene node of every instance
+		std::vector<int> nodes;
+	};
+
+	// Keeps the mapping alive for as long as the views are in use
+	struct Entry
+	{
+		MappedFile file;
+		SceneGraph scene;
+		std::vector<CachedMesh> meshes;
+	};
+
+	static std::unique_ptr<Entry> Load(const std::string& sourcePath, unsigned int importFlags);
+	// meshNodes holds the scene nodes each mesh is instanced at
+	static bool Store(const std::string& sourcePath, unsigned int importFlags, const std::vector<Mesh>& meshes,
+		const SceneGraph& scene, const std::vector<std::vector<int>>& meshNodes);
+
+	// Removes least recently used entries until the directory fits in the budget
+	static void Evict(uint64_t budgetBytes);
+
+	static void SetDirectory(const std::string& directory);
+	static void SetBudget(uint64_t budgetBytes);
+private:
+	static std::string s_Directory;
+	static uint64_t s_BudgetBytes;
+
+	static bool GetSourceKey(const std::string& sourcePath, uint64_t& size, int64_t& mtime);
+	static std::string GetEntryPath(const std::string& sourcePath, uint64_t size, int64_t mtime, unsigned int importFlags);
+};
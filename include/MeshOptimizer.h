@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+struct Vertex;
+
+// Post-transform vertex cache behaviour of an index buffer, simulated as a FIFO
+struct VertexCacheStats
+{
+	size_t triangles = 0;
+	size_t vertices = 0;
+	size_t misses = 0;
+
+	// Average cache miss ratio: transformed vertices per triangle, 0.5 at best
+	inline float GetACMR() const { return triangles ? (float)misses / triangles : 0.0f; }
+	// Average transform to vertex ratio: 1.0 means every vertex is shaded once
+	inline float GetATVR() const { return vertices ? (float)misses / vertices : 0.0f; }
+
+	inline VertexCacheStats& operator+=(const VertexCacheStats& other)
+	{
+		triangles += other.triangles;
+		vertices += other.vertices;
+		misses += other.misses;
+		return *this;
+	}
+};
+
+// Reorders triangle lists for the GPU, after "Fast Triangle Reordering for
+// Vertex Locality and Reduced Overdraw" (Sander, Nehab, Barczak 2007):
+// Tipsify for the vertex cache, then clusters sorted so outward-facing
+// surfaces draw first, then vertices renumbered in first-use order so the
+// vertex array is fetched roughly sequentially.
+class MeshOptimizer
+{
+public:
+	static const unsigned int kCacheSize = 16;
+
+	// Runs all three passes; vertices are rewritten and unreferenced ones dropped
+	static void Optimize(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+	// Returns the triangle offsets where the order had to jump to a new region
+	static std::vector<size_t> OptimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = kCacheSize);
+	static void OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices, const std::vector<size_t>& hardBoundaries,
+		unsigned int cacheSize = kCacheSize, float threshold = 1.05f);
+	static void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+	static VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = kCacheSize);
+};
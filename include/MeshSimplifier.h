@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+struct Vertex;
+
+// Quadric error edge collapse (Garland & Heckbert) that only rewrites the
+// index list: every collapse moves one vertex onto a neighbour that already
+// exists, so all levels of detail can index the same vertex buffer.
+// Open borders may only slide along themselves, and vertices shared by
+// several wedges (UV or normal seams) stay fixed.
+class MeshSimplifier
+{
+public:
+	// Collapses edges until at most targetIndexCount indices remain or no legal
+	// collapse is left. error receives the largest object-space deviation.
+	static std::vector<unsigned int> Simplify(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+		size_t targetIndexCount, float& error);
+};
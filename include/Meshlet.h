@@ -0,0 +1,46 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct Vertex;
+struct DrawRange;
+
+// A run of up to kMaxTriangles consecutive triangles of an index buffer,
+// bounded by a sphere and a cone around its face normals. indexOffset is in
+// indices, like DrawRange, so visible meshlets can be drawn in place.
+struct Meshlet
+{
+	glm::vec3 center;
+	float radius;
+	glm::vec3 coneAxis;
+	// Sine of the cone half-angle; 1 means the normals are too spread to cull
+	float coneCutoff;
+	uint32_t indexOffset;
+	uint32_t indexCount;
+	int32_t baseVertex;
+};
+
+// Cuts index ranges into meshlets. Triangles are taken in buffer order, which
+// after vertex cache optimization already walks the surface in small patches.
+class MeshletBuilder
+{
+public:
+	static const size_t kMaxVertices = 64;
+	static const size_t kMaxTriangles = 124;
+
+	// order maps packed vertices back to the source array and may be null
+	static void Build(const Vertex* vertices, const unsigned int* order, size_t vertexCount, const void* indices, GLenum indexType,
+		const DrawRange& range, std::vector<Meshlet>& out);
+
+	// True when no triangle of the meshlet can face a camera at cameraPosition
+	static inline bool IsBackfacing(const Meshlet& meshlet, const glm::vec3& cameraPosition)
+	{
+		glm::vec3 direction = meshlet.center - cameraPosition;
+		return glm::dot(direction, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(direction) + meshlet.radius;
+	}
+};
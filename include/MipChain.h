@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Tightly packed 8-bit RGBA image
+struct ImageRGBA8
+{
+	int width = 0;
+	int height = 0;
+	std::vector<unsigned char> pixels;
+};
+
+enum MipFilter
+{
+	MIP_FILTER_BOX,
+	MIP_FILTER_KAISER
+};
+
+// Builds full mip chains on the CPU so the GL thread only uploads finished
+// levels. Colour data is filtered in linear space; each level is produced
+// from the previous one in block rows spread over the thread pool. Kernels
+// use AVX2 or SSE2 when the build targets them and plain C++ otherwise.
+class MipChain
+{
+public:
+	// RGB, grey and grey-alpha to RGBA; missing alpha becomes opaque
+	static ImageRGBA8 ExpandToRGBA(const unsigned char* pixels, int width, int height, int channels);
+	static void ExpandToRGBA(const unsigned char* pixels, size_t pixelCount, int channels, unsigned char* out);
+
+	// Returns every level from base down to 1x1, base first
+	static std::vector<ImageRGBA8> Build(ImageRGBA8 base, MipFilter filter, bool srgb);
+
+	static const char* GetInstructionSet();
+
+	// Forces the scalar kernels, for benchmarking
+	static void SetSimdEnabled(bool enabled);
+private:
+	static bool s_SimdEnabled;
+};
@@ -14,25 +14,206 @@
 #include <iostream>
 #include <map>
 #include <vector>
+#include <atomic>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
 
+#include "FrustumCuller.h"
+#include "GeometryArena.h"
+#include "ImportProfile.h"
+#include "OcclusionCuller.h"
+#include "RenderQueue.h"
+#include "SceneGraph.h"
 #include "Mesh.h"
 #include "Shader.h"
-
-unsigned int LoadTextureFile(const char* path, const std::string& directory, bool gamma = false);
+#include "ShaderVariants.h"
+#include "Timer.h"
+#include "UniformBuffer.h"
+#include "VertexFormat.h"
 
 class Model
 {
 public:
+	// One entry per TextureCache reference held by this model
 	std::vector<Texture> textures_loaded;
 	std::vector<Mesh> meshes;
 	std::string directory;
 
+	// Route plain .obj files through ObjLoader instead of Assimp
+	static bool useNativeObj;
+	// Assimp post-processing profile, trimmed to the attributes the shader reads
+	static std::string importProfile;
+	static unsigned int vertexAttributes;
+	// Largest on-screen error, in pixels, a simplified level may show
+	static float lodPixelError;
+	// Skip meshlets outside the frustum or facing away from the camera
+	static bool clusterCulling;
+	// Skip meshes hidden behind the biggest on-screen meshes, tested on the CPU
+	static bool occlusionCulling;
+	// Pack meshes into buffers shared per vertex layout, and draw meshes with
+	// the same node, material and buffers as one multi-draw
+	static bool mergeGeometry;
+
+	// Starts importing on a background thread; meshes show up through Update()
 	Model(std::string const& path, bool gamma = false);
-	
-	void Draw(Shader& shader);
+	~Model();
+
+	Model(const Model&) = delete;
+	Model& operator=(const Model&) = delete;
+
+	// Uploads meshes the loader has finished, spending roughly budgetMs of the
+	// frame. Must be called on the GL context thread.
+	void Update(double budgetMs = 4.0);
+	// Draws every mesh at its node's transform, without culling. Each mesh
+	// uses the variant of shaders matching its features.
+	void Draw(ShaderVariants& shaders);
+	// Skips meshes outside the view frustum or occluded, then selects each visible mesh's
+	// level of detail and culls its meshlets
+	void Draw(ShaderVariants& shaders, const ViewInfo& view);
+
+	inline bool IsLoaded() const { return m_Uploaded; }
+	inline bool HasFailed() const { return m_State == LOAD_FAILED; }
+	inline const std::string& GetError() const { return m_Error; }
+
+	// Node hierarchy of the model, with a root that centers it on the origin.
+	// Local transforms may be changed between frames; Draw() picks them up.
+	inline SceneGraph& GetScene() { return m_Scene; }
+	// Every placement of a mesh is an instance; meshes with identical geometry
+	// are uploaded once and drawn instanced
+	inline size_t GetInstanceCount() const { return m_InstanceNodes.size(); }
+	inline size_t GetInstanceMesh(size_t instance) const { return m_InstanceMeshes[instance]; }
+	inline int GetInstanceNode(size_t instance) const { return m_InstanceNodes[instance]; }
 private:
+	enum LoadState
+	{
+		LOAD_RUNNING,
+		LOAD_PRODUCED,
+		LOAD_FAILED
+	};
+
+	// Handoff item from the loader thread to the GL thread. Either owns its
+	// arrays in data, or points into a mapped cache entry kept alive by source.
+	// packed is the upload layout and occluder the occlusion proxy, both built
+	// off the GL thread by PushMesh().
+	struct PendingMesh
+	{
+		MeshData data;
+		const Vertex* vertices = nullptr;
+		size_t vertexCount = 0;
+		const unsigned int* indices = nullptr;
+		size_t indexCount = 0;
+		std::shared_ptr<const void> source;
+		PackedMesh packed;
+		OccluderMesh occluder;
+		std::vector<int> nodes;
+	};
+
+	std::string m_Path;
+	ImportProfile m_Profile;
+	std::thread m_Loader;
+	std::mutex m_QueueMutex;
+	std::deque<PendingMesh> m_Ready;
+	std::atomic<int> m_State;
+	std::atomic<bool> m_Cancel;
+	std::string m_Error;
+	bool m_Uploaded;
+	bool m_TexturesReported;
+	bool m_StoreInCache;
+	std::future<void> m_CacheStore;
+	Timer m_LoadTimer;
+
+	// The loader hands its finished hierarchy over before pushing any mesh
+	SceneGraph m_Scene;
+	std::unique_ptr<SceneGraph> m_PendingScene;
+
+	// Instances by mesh, and each instance's mesh, node and current level
+	std::vector<std::vector<uint32_t>> m_MeshInstances;
+	std::vector<uint32_t> m_InstanceMeshes;
+	std::vector<int> m_InstanceNodes;
+	// First node with the same world transform as the instance's, kept with the bounds
+	std::vector<int> m_InstanceSpaces;
+	std::vector<uint8_t> m_InstanceLods;
+
+	// Box of every entry in meshes in its own space, of every instance in
+	// model space, and the last culling result
+	std::vector<glm::vec3> m_ObjectBoundsMin, m_ObjectBoundsMax;
+	BoundsArray m_InstanceBounds;
+	bool m_InstanceBoundsDirty;
+	std::vector<uint8_t> m_InstanceVisible;
+	std::vector<OccluderMesh> m_Occluders;
+	// Visible instances of the mesh being drawn
+	std::vector<ObjectData> m_DrawTransforms;
+	std::vector<uint8_t> m_DrawLods;
+
+	// Small ids for each mesh's texture set and VAO. Visible single-instance
+	// meshes are sorted by world transform, material and VAO, and each run
+	// becomes one packet in the render queue.
+	std::vector<std::unique_ptr<GeometryArena>> m_Arenas;
+	std::map<std::vector<unsigned int>, uint32_t> m_Materials;
+	std::map<unsigned int, uint32_t> m_VertexArrays;
+	std::vector<uint32_t> m_MeshMaterials, m_MeshVertexArrays;
+	// Full ids: only the render queue key clamps them, where they just order packets
+	struct BatchEntry
+	{
+		int space;
+		uint32_t material;
+		uint32_t vertexArray;
+		uint32_t instance;
+
+		inline bool SharesDraw(const BatchEntry& other) const
+		{
+			return space == other.space && material == other.material && vertexArray == other.vertexArray;
+		}
+		inline bool operator<(const BatchEntry& other) const
+		{
+			return std::tie(space, material, vertexArray, instance) < std::tie(other.space, other.material, other.vertexArray, other.instance);
+		}
+	};
+	std::vector<BatchEntry> m_Batch;
+	DrawList m_DrawList;
+	RenderQueue m_Queue;
+	// The queue's transforms for the frame, one aligned ObjectData block each
+	std::unique_ptr<UniformBuffer> m_ObjectBuffer;
+	std::vector<unsigned char> m_ObjectStaging;
+	OcclusionCuller m_Occlusion;
+
+	// Proxy drawn as a wire box around the model until every mesh is uploaded
+	bool m_HasBounds;
+	glm::vec3 m_BoundsMin, m_BoundsMax;
+	unsigned int m_ProxyVAO, m_ProxyVBO;
+
 	void LoadModel(std::string const& path);
-	void ProcessNode(aiNode* node, const aiScene* scene);
-	Mesh ProcessMesh(aiMesh* mesh, const aiScene* scene);
-	std::vector<Texture> LoadTextures(aiMaterial* mat, aiTextureType type, std::string typeName);
-};
\ No newline at end of file
+	bool LoadFromCache(std::string const& path);
+	bool LoadNativeObj(std::string const& path);
+	void ProcessNode(aiNode* node, const aiScene* scene, int parent, SceneGraph& graph, std::vector<aiMesh*>& order, std::vector<int>& nodes);
+	void ProcessMeshes(const std::vector<aiMesh*>& order, const std::vector<int>& nodes, const aiScene* scene);
+	void CenterScene(SceneGraph& graph, const std::vector<aiMesh*>& order, const std::vector<int>& nodes);
+	static void AddPlacedBounds(const glm::mat4& world, const glm::vec3& meshMin, const glm::vec3& meshMax, glm::vec3& boundsMin, glm::vec3& boundsMax);
+	static MeshData ProcessMesh(const aiMesh* mesh, const aiScene* scene);
+	static uint64_t HashMesh(const aiMesh* mesh);
+	static bool SameMeshContents(const aiMesh* a, const aiMesh* b);
+	static void OptimizeMesh(MeshData& data);
+	static void BuildLods(MeshData& data);
+	static void PrintCacheStats(const VertexCacheStats& before, const VertexCacheStats& after);
+	static void AddLodTriangles(const MeshData& data, std::vector<size_t>& triangles);
+	static void PrintLodStats(const std::vector<size_t>& triangles);
+	static void CollectMaterialTextures(const aiMaterial* material, std::vector<TextureRef>& out);
+	static void CollectTextures(const aiMaterial* mat, aiTextureType type, const std::string& typeName, std::vector<TextureRef>& out);
+	std::vector<Texture> LoadTextures(const std::vector<TextureRef>& refs);
+	void PrintMeshInfo(const aiMesh* mesh);
+
+	void PushMesh(PendingMesh mesh);
+	void SetBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+	void SetScene(SceneGraph graph);
+	void UpdateInstanceBounds();
+	GeometryArena* GetArena(const PackedMesh& packed);
+	void DrawProxy(ShaderVariants& shaders);
+	void CullOccluded(const ViewInfo& view, const glm::vec3& cameraPosition);
+	void ExecuteQueue(ShaderVariants& shaders);
+	size_t CountStateChanges(const std::vector<DrawPacket>& packets) const;
+	float GetInstanceDepth(uint32_t instance, const glm::vec3& cameraPosition) const;
+};
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+
+#include "Mesh.h"
+
+// Fast path for geometry-only Wavefront OBJ files. The file is memory mapped,
+// split into newline-aligned chunks that are parsed on the thread pool, and the
+// v/vt/vn triples are welded into the Vertex layout through a hash partitioned
+// by shard. Anything beyond v/vt/vn/f/o/g/s (materials, lines, free-form
+// geometry) makes Load return false so the caller can fall back to Assimp.
+class ObjLoader
+{
+public:
+	// Output matches Assimp's Triangulate | GenSmoothNormals | FlipUVs
+	static bool Load(const std::string& path, MeshData& out);
+};
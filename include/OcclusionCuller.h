@@ -0,0 +1,76 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Mesh.h"
+
+// Low-poly stand-in for a mesh, rasterized into the occlusion buffer.
+// depthBias pushes it back by its simplification error so a proxy that
+// grew during simplification does not hide what the real mesh would show.
+struct OccluderMesh
+{
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> indices;
+	float depthBias = 0.0f;
+
+	inline size_t GetTriangleCount() const { return indices.size() / 3; }
+};
+
+// Coarse CPU depth buffer for occlusion culling. Occluders are transformed
+// and binned on the calling thread, then rasterized tile by tile on the
+// thread pool, 4 pixels at a time with SSE. Every covered pixel keeps the
+// nearest occluder's farthest view depth, so the buffer never claims more
+// occlusion than the geometry provides. A max-depth pyramid built on top
+// lets a box be tested against a few texels whatever its screen size.
+class OcclusionCuller
+{
+public:
+	static const int kWidth = 256;
+	static const int kTileWidth = 32;
+	static const int kTileHeight = 16;
+	static const size_t kMaxOccluderTriangles = 1024;
+
+	// Proxy from the coarsest level of detail within kMaxOccluderTriangles;
+	// empty when even that is too detailed to be worth rasterizing
+	static OccluderMesh BuildOccluder(const Vertex* vertices, const unsigned int* indices, const std::vector<MeshLod>& lods);
+
+	// Clears the buffer for a new frame. The height follows the viewport aspect ratio.
+	void Begin(const glm::mat4& modelViewProjection, float viewportAspect);
+	// transform places the occluder in the space the boxes are tested in. The
+	// occluder must stay alive until Rasterize() returns.
+	void AddOccluder(const OccluderMesh& occluder, const glm::mat4& transform);
+	void Rasterize();
+
+	// False when the box is certainly hidden behind the rasterized occluders
+	bool IsVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+
+	inline size_t GetOccluderTriangles() const { return m_Triangles.size(); }
+	inline int GetHeight() const { return m_Height; }
+	inline const float* GetDepth() const { return m_Levels.empty() ? nullptr : m_Levels[0].data(); }
+private:
+	struct ScreenTriangle
+	{
+		float x[3], y[3];
+		float depth;
+		int minX, minY, maxX, maxY;
+	};
+
+	glm::mat4 m_Transform = glm::mat4(1.0f);
+	int m_Height = 0;
+	int m_TilesX = 0, m_TilesY = 0;
+	std::vector<const OccluderMesh*> m_Occluders;
+	std::vector<glm::mat4> m_OccluderTransforms;
+	std::vector<ScreenTriangle> m_Triangles;
+	std::vector<std::vector<uint32_t>> m_Bins;
+
+	// Level 0 is the depth buffer; each further level keeps the max of 2x2 texels
+	std::vector<std::vector<float>> m_Levels;
+	std::vector<glm::ivec2> m_LevelSizes;
+
+	void RasterizeTile(int tile);
+	void BuildHierarchy();
+};
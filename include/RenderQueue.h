@@ -0,0 +1,68 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "Mesh.h"
+#include "UniformBuffer.h"
+
+enum RenderPass
+{
+	RENDER_PASS_OPAQUE = 0
+};
+
+// One draw of a frame. The payload indexes into the queue's arrays, so
+// sorting only moves these 32 bytes. Instanced packets draw instanceCount
+// copies from the instance arrays; the others draw runCount multi-draw runs
+// with transform as the object data.
+struct DrawPacket
+{
+	uint64_t key;
+	uint32_t mesh;
+	uint32_t transform;
+	uint32_t first;
+	uint32_t runCount;
+	uint32_t instanceCount;
+	uint32_t reserved;
+};
+
+// Draw packets for one frame, radix-sorted by a 64-bit key so the executor
+// sees packets sharing state next to each other. Key layout, from the top:
+// pass (4 bits), program (8), material (20), vertex array (8), depth (24).
+class RenderQueue
+{
+public:
+	// depth is the packet's distance from the camera; nearer packets sort first
+	static uint64_t MakeKey(unsigned int pass, unsigned int program, uint32_t material, uint32_t vertexArray, float depth);
+	static inline uint32_t GetProgram(uint64_t key) { return (uint32_t)(key >> 52) & 0xFF; }
+	static inline uint32_t GetMaterial(uint64_t key) { return (uint32_t)(key >> 32) & 0xFFFFF; }
+	static inline uint32_t GetVertexArray(uint64_t key) { return (uint32_t)(key >> 24) & 0xFF; }
+
+	void Clear();
+	// Stores the transform with its normal matrix
+	uint32_t AddTransform(const glm::mat4& transform);
+	// Copies the runs of list and returns the index of the first
+	uint32_t AddRuns(const DrawList& list);
+	uint32_t AddInstances(const ObjectData* instances, const uint8_t* lods, size_t count);
+	inline void Push(const DrawPacket& packet) { m_Packets.push_back(packet); }
+
+	// LSD radix sort on the key, one byte per pass, skipping bytes all keys share
+	void Sort();
+
+	inline const std::vector<DrawPacket>& GetPackets() const { return m_Packets; }
+	inline const std::vector<ObjectData>& GetTransforms() const { return m_Transforms; }
+	inline const GLsizei* GetRunCounts(uint32_t first) const { return m_Runs.counts.data() + first; }
+	inline const void* const* GetRunOffsets(uint32_t first) const { return m_Runs.offsets.data() + first; }
+	inline const GLint* GetRunBaseVertices(uint32_t first) const { return m_Runs.baseVertices.data() + first; }
+	inline const ObjectData* GetInstanceTransforms(uint32_t first) const { return m_InstanceTransforms.data() + first; }
+	inline const uint8_t* GetInstanceLods(uint32_t first) const { return m_InstanceLods.data() + first; }
+private:
+	std::vector<DrawPacket> m_Packets, m_Scratch;
+	std::vector<ObjectData> m_Transforms;
+	DrawList m_Runs;
+	std::vector<ObjectData> m_InstanceTransforms;
+	std::vector<uint8_t> m_InstanceLods;
+};
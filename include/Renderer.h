@@ -4,19 +4,100 @@
 #include <glm/glm.hpp>
 #include <iostream>
 
-#define ASSERT(x) if (!(x)) __debugbreak();
-#define GLCall(x) GLClearError();\
-	x;\
-	ASSERT(GLLogCall(#x, __FILE__, __LINE__))
+#include "UniformBuffer.h"
+
+#include <csignal>
+#include <cstdlib>
+
+#if defined(_MSC_VER)
+#define DEBUG_BREAK() __debugbreak()
+#elif defined(SIGTRAP)
+#define DEBUG_BREAK() std::raise(SIGTRAP)
+#else
+#define DEBUG_BREAK() std::abort()
+#endif
+
+#ifdef NDEBUG
+#define ASSERT(x) ((void)0)
+#else
+#define ASSERT(x) do { if (!(x)) DEBUG_BREAK(); } while (0)
+#endif
+
+// How GLCall checks for errors, set with -DMODELVIEWER_GL_CHECKS=<n>:
+//   0  not at all; GLCall(x) is just x. The default with NDEBUG.
+//   1  through the GL 4.3 debug output callback, which reports the GLCall it
+//      fired in. The default otherwise; contexts without it fall back to 2.
+//   2  glGetError before and after every call
+#ifndef MODELVIEWER_GL_CHECKS
+#ifdef NDEBUG
+#define MODELVIEWER_GL_CHECKS 0
+#else
+#define MODELVIEWER_GL_CHECKS 1
+#endif
+#endif
+
+#if MODELVIEWER_GL_CHECKS
+#define GLCall(x) do { GLBeginCall(#x, __FILE__, __LINE__); x; GLEndCall(); } while (0)
+#else
+#define GLCall(x) x
+#endif
 
 void GLClearError();
 bool GLLogCall(const char* function, const char* file, int line);
+// Record the call site for the debug callback, or drain/check glGetError when checks are synchronous
+void GLBeginCall(const char* function, const char* file, int line);
+void GLEndCall();
+
+// Optional features detected once by Renderer::Init()
+struct RendererCaps
+{
+    bool textureCompressionS3TC = false;
+    bool textureCompressionRGTC = false;
+    bool textureCompressionBPTC = false;
+    // glGetProgramBinary/glProgramBinary are loaded and the driver offers a binary format
+    bool programBinary = false;
+    // GL_COMPLETION_STATUS_KHR can be polled without waiting for a compile
+    bool parallelShaderCompile = false;
+};
+
+// Counters for the frame being drawn, cleared by Renderer::ResetStats()
+struct RenderStats
+{
+    size_t meshes = 0;
+    size_t frustumCulledMeshes = 0;
+    size_t occludedMeshes = 0;
+    size_t occludedTriangles = 0;
+    size_t occluderTriangles = 0;
+    double occlusionMs = 0.0;
+    size_t clusters = 0;
+    size_t frustumCulledClusters = 0;
+    size_t backfaceCulledClusters = 0;
+    size_t drawCalls = 0;
+    size_t triangles = 0;
+    double submitMs = 0.0;
+    // Binds and uniform updates issued by the render queue, and how many the
+    // same packets would need in submission order
+    size_t stateChanges = 0;
+    size_t unsortedStateChanges = 0;
+};
 
 class Renderer
 {
 public:
+    // Call once after the GL function pointers are loaded
     static void Init();
+    static const RendererCaps& GetCaps();
+    static RenderStats& GetStats();
+    static void ResetStats();
     static void Shutdown();
+    // The GL error checking in effect: "off", "debug output" or "glGetError per call"
+    static const char* GetErrorCheckMode();
+
+    // Uniform blocks shared by every program. The frame block is written once
+    // per frame; SetObjectTransform writes the next slot of a small ring and
+    // binds it, for draws that are not fed from a prebuilt object buffer.
+    static void SetFrameData(const FrameData& frame);
+    static void SetObjectTransform(const glm::mat4& model);
     
     // Clear functions
     static void Clear();
@@ -57,6 +138,11 @@ public:
     static void EndImGui();
     
 private:
+    static RendererCaps s_Caps;
+    static RenderStats s_Stats;
+    static UniformBuffer* s_FrameBuffer;
+    static UniformBuffer* s_ObjectBuffer;
+    static size_t s_ObjectSlot;
     static bool s_DepthTestEnabled;
     static bool s_FaceCullingEnabled;
     static bool s_BlendingEnabled;
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Node hierarchy flattened into parallel arrays in depth-first order, so a
+// parent always comes before its children and every subtree is one
+// contiguous index range. Changing a local transform only flags the node;
+// Update() then recomputes the world transforms of flagged subtrees, handing
+// independent subtrees to the thread pool when there are enough nodes.
+class SceneGraph
+{
+public:
+	static const int kNoParent = -1;
+
+	// parent must already exist and the new node must come after all of its
+	// existing descendants, which holds when nodes are added depth first
+	int AddNode(int parent, const glm::mat4& local, const std::string& name = std::string());
+	void Clear();
+
+	void SetLocal(int node, const glm::mat4& local);
+	int FindNode(const std::string& name) const;
+
+	// Returns the number of world transforms that were recomputed
+	size_t Update();
+
+	inline size_t GetNodeCount() const { return m_Parents.size(); }
+	inline int GetParent(int node) const { return m_Parents[node]; }
+	inline int GetSubtreeEnd(int node) const { return m_SubtreeEnds[node]; }
+	inline const std::string& GetName(int node) const { return m_Names[node]; }
+	inline const glm::mat4& GetLocal(int node) const { return m_Local[node]; }
+	inline const glm::mat4& GetWorld(int node) const { return m_World[node]; }
+private:
+	std::vector<int> m_Parents;
+	std::vector<int> m_SubtreeEnds;
+	std::vector<std::string> m_Names;
+	std::vector<glm::mat4> m_Local;
+	std::vector<glm::mat4> m_World;
+	std::vector<uint8_t> m_Dirty;
+	bool m_AnyDirty = false;
+
+	void UpdateRange(int begin, int end);
+};
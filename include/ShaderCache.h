@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Linked program binaries kept on disk between launches. Entries are keyed by
+// a hash of the preprocessed sources and the GL vendor, renderer and version
+// strings, so a driver update or an edited include misses instead of loading
+// a stale binary. Needs GL 4.1 for glGetProgramBinary; elsewhere every
+// lookup misses and nothing is stored.
+class ShaderCache
+{
+public:
+	static uint64_t GetKey(const std::string& vertexSource, const std::string& fragmentSource);
+
+	// Restores the binary into program; false if there is no usable entry
+	static bool Load(uint64_t key, unsigned int program);
+	// Call after a successful link of a program created with the retrievable hint
+	static bool Store(uint64_t key, unsigned int program);
+
+	static bool IsSupported();
+	static void SetDirectory(const std::string& directory);
+private:
+	static std::string s_Directory;
+
+	static std::string GetEntryPath(uint64_t key);
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Shader.h"
+
+// Specializations of one .shader file, one per combination of ShaderFeature
+// bits, so the shaders test features with #ifdef instead of branching per
+// vertex or pixel. A variant is compiled the first time it is asked for and
+// kept; until it is ready, Get() hands out the fallback program.
+class ShaderVariants
+{
+public:
+	ShaderVariants(const std::string& path, Shader& fallback);
+
+	// Starts the compile on first request; never waits
+	Shader& Get(unsigned int features);
+	// Polls the variants still compiling and checks the attributes of newly
+	// ready ones against their features; call once per frame
+	void Update();
+
+	// Program id for render queue keys
+	static inline uint32_t GetProgramId(unsigned int features) { return features & SHADER_FEATURE_ALL; }
+	static std::vector<std::string> GetDefines(unsigned int features);
+	// VERTEX_ATTRIBUTE_* bits a variant with these features reads
+	static unsigned int GetVertexAttributes(unsigned int features);
+
+	// Variants requested so far, and their total build time once ready
+	size_t GetVariantCount() const;
+	double GetBuildMs() const;
+private:
+	std::string m_Path;
+	Shader& m_Fallback;
+	std::unique_ptr<Shader> m_Variants[SHADER_FEATURE_ALL + 1];
+	bool m_Checked[SHADER_FEATURE_ALL + 1] = {};
+};
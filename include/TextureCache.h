@@ -0,0 +1,105 @@
+#pragma once
+
+#include "TextureCompressor.h"
+
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A texture decoded on a worker thread with its full mip chain, waiting for
+// upload. Holds either RGBA levels or block-compressed ones.
+struct DecodedImage
+{
+	int width = 0;
+	int height = 0;
+	int channels = 0;
+	std::vector<ImageRGBA8> levels;
+	CompressedImage compressed;
+
+	inline bool IsValid() const { return !levels.empty() || !compressed.levels.empty(); }
+};
+
+void UploadTexture(unsigned int textureID, const DecodedImage& image);
+
+// Process-wide texture cache. Files are shared by canonical absolute path and,
+// failing that, by a hash of their contents, so the same image under two
+// names or used by two models is uploaded once. The role is part of both
+// keys since it decides the block format. Textures are reference
+// counted and deleted when the last user releases them.
+//
+// Decoding runs on the thread pool. Acquire() returns a texture holding a 1x1
+// white placeholder until Update() uploads the real pixels.
+class TextureCache
+{
+public:
+	struct Stats
+	{
+		uint64_t pathHits = 0;
+		uint64_t contentHits = 0;
+		uint64_t misses = 0;
+		size_t textureCount = 0;
+		uint64_t residentBytes = 0;
+	};
+
+	static TextureCache& Get();
+
+	// Starts reading, hashing and decoding ahead of use; safe from any thread
+	void Prefetch(const std::string& filename, TextureRole role);
+
+	// GL thread only. Every Acquire() must be paired with a Release().
+	unsigned int Acquire(const std::string& filename, TextureRole role);
+	void Release(unsigned int textureID);
+	void Update();
+
+	inline bool IsIdle() const { return m_Pending.empty(); }
+	inline const Stats& GetStats() const { return m_Stats; }
+private:
+	struct Decode
+	{
+		std::shared_future<uint64_t> contentHash;
+		std::shared_future<DecodedImage> image;
+	};
+
+	struct Entry
+	{
+		unsigned int refCount = 0;
+		// Content key in m_ByContent, if this entry holds it
+		uint64_t contentHash = 0;
+		uint64_t residentBytes = 0;
+		// Canonical path of the file first loaded, for comparing contents
+		std::string sourcePath;
+		std::vector<std::string> paths;
+	};
+
+	struct PendingUpload
+	{
+		unsigned int textureID;
+		TextureRole role;
+		std::string key;
+		std::string path;
+		std::shared_future<uint64_t> contentHash;
+		std::shared_future<DecodedImage> image;
+	};
+
+	// Guards the decode table and the path index, which Prefetch() reads
+	std::mutex m_Mutex;
+	std::unordered_map<std::string, Decode> m_Decodes;
+	std::unordered_map<std::string, unsigned int> m_ByPath;
+
+	std::unordered_map<uint64_t, unsigned int> m_ByContent;
+	std::unordered_map<unsigned int, Entry> m_Entries;
+	std::vector<PendingUpload> m_Pending;
+	Stats m_Stats;
+
+	TextureCache() = default;
+	~TextureCache();
+
+	static std::string Canonicalize(const std::string& filename);
+	static std::string MakeKey(const std::string& path, TextureRole role);
+	static uint64_t MakeContentKey(uint64_t contentHash, TextureRole role);
+	Decode StartDecode(const std::string& path, TextureRole role);
+};
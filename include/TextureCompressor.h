@@ -0,0 +1,62 @@
+#pragma once
+
+#include "MipChain.h"
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// How a texture is sampled decides which block format suits it
+enum TextureRole
+{
+	TEXTURE_ROLE_DIFFUSE,
+	TEXTURE_ROLE_SPECULAR,
+	TEXTURE_ROLE_NORMAL,
+	TEXTURE_ROLE_HEIGHT
+};
+
+TextureRole TextureRoleFromType(const std::string& type);
+
+struct CompressedLevel
+{
+	int width;
+	int height;
+	std::vector<unsigned char> data;
+};
+
+struct CompressedImage
+{
+	GLenum format = 0;
+	std::vector<CompressedLevel> levels;
+};
+
+// CPU BCn encoder. Every level of a mip chain is compressed with block rows
+// spread over the thread pool; results are kept in cache/textures so later launches only
+// read the finished blocks back.
+class TextureCompressor
+{
+public:
+	// Picks BC1/BC3/BC4/BC5/BC7 for the role, or 0 when the driver lacks the format
+	static GLenum ChooseFormat(TextureRole role, int channels, bool hasAlpha);
+
+	static bool Compress(const std::vector<ImageRGBA8>& levels, GLenum format, CompressedImage& out);
+	static bool LoadCached(uint64_t contentHash, TextureRole role, CompressedImage& out);
+	static bool StoreCached(uint64_t contentHash, TextureRole role, const CompressedImage& image);
+
+	static size_t GetBlockSize(GLenum format);
+
+	static void SetEnabled(bool enabled);
+	static bool IsEnabled();
+private:
+	static bool s_Enabled;
+	static std::string GetCachePath(uint64_t contentHash, TextureRole role);
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+private:
+	std::vector<std::thread> m_Workers;
+	std::queue<std::function<void()>> m_Jobs;
+	std::mutex m_Mutex;
+	std::condition_variable m_Condition;
+	bool m_Stopping;
+
+	void Enqueue(std::function<void()> job);
+	void WorkerLoop();
+	bool RunPendingJob();
+public:
+	// threadCount == 0 picks one worker per hardware thread
+	explicit ThreadPool(unsigned int threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	template<typename F>
+	auto Submit(F&& task) -> std::future<decltype(task())>
+	{
+		using Result = decltype(task());
+		auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+		std::future<Result> result = packaged->get_future();
+		Enqueue([packaged]() { (*packaged)(); });
+		return result;
+	}
+
+	// Splits [0, count) into contiguous ranges, runs body(begin, end) on each and
+	// blocks until all are done. The calling thread takes the first range and then
+	// helps with queued jobs while it waits, so this is safe to nest inside a job.
+	template<typename F>
+	void ParallelFor(size_t count, F&& body, size_t minRange = 1)
+	{
+		if (count == 0)
+			return;
+
+		size_t rangeCount = std::min<size_t>(GetThreadCount() + 1, (count + minRange - 1) / minRange);
+		size_t rangeSize = (count + rangeCount - 1) / rangeCount;
+
+		std::vector<std::future<void>> pending;
+		for (size_t begin = rangeSize; begin < count; begin += rangeSize)
+		{
+			size_t end = std::min(count, begin + rangeSize);
+			pending.push_back(Submit([&body, begin, end]() { body(begin, end); }));
+		}
+
+		body(size_t(0), std::min(count, rangeSize));
+		for (auto& job : pending)
+		{
+			while (job.wait_for(std::chrono::seconds(0)) != std::future_status::ready && RunPendingJob())
+				;
+			job.get();
+		}
+	}
+
+	// Like ParallelFor, but the caller only ever runs ranges of this loop, never
+	// other queued jobs, so a frame cannot stall behind import work. Ranges are
+	// claimed from a counter: whatever the workers have not started by the time
+	// the caller gets to it, the caller runs itself.
+	template<typename F>
+	void ParallelForIsolated(size_t count, F&& body, size_t minRange = 1)
+	{
+		if (count == 0)
+			return;
+
+		size_t rangeCount = std::min<size_t>(GetThreadCount() + 1, (count + minRange - 1) / minRange);
+		size_t rangeSize = (count + rangeCount - 1) / rangeCount;
+
+		struct State
+		{
+			std::atomic<size_t> next{ 0 };
+			std::atomic<size_t> done{ 0 };
+			std::mutex mutex;
+			std::condition_variable finished;
+		};
+		auto state = std::make_shared<State>();
+
+		// A helper that starts after every range is claimed returns without touching body
+		auto run = [state, &body, count, rangeCount, rangeSize]() {
+			for (size_t range = state->next++; range < rangeCount; range = state->next++)
+			{
+				size_t begin = range * rangeSize;
+				if (begin < count)
+					body(begin, std::min(count, begin + rangeSize));
+				if (++state->done == rangeCount)
+				{
+					std::lock_guard<std::mutex> lock(state->mutex);
+					state->finished.notify_all();
+				}
+			}
+		};
+		for (size_t i = 1; i < rangeCount; i++)
+			Enqueue(run);
+
+		run();
+		std::unique_lock<std::mutex> lock(state->mutex);
+		state->finished.wait(lock, [&state, rangeCount]() { return state->done == rangeCount; });
+	}
+
+	inline unsigned int GetThreadCount() const { return static_cast<unsigned int>(m_Workers.size()); }
+
+	// Process-wide pool shared by the loaders
+	static ThreadPool& Get();
+};
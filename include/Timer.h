@@ -0,0 +1,19 @@
+#pragma once
+
+#include <chrono>
+
+class Timer
+{
+private:
+	std::chrono::steady_clock::time_point m_Start;
+public:
+	Timer()
+		: m_Start(std::chrono::steady_clock::now()) {}
+
+	inline void Reset() { m_Start = std::chrono::steady_clock::now(); }
+
+	inline double ElapsedMs() const
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_Start).count();
+	}
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+// Uniform block binding points, the same in every program. Shader binds the
+// blocks it finds by name after linking.
+enum UniformBinding
+{
+	UNIFORM_BINDING_FRAME = 0,
+	UNIFORM_BINDING_OBJECT = 1
+};
+
+// std140 layout of the FrameData block: written once per frame
+struct FrameData
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 viewProjection;
+	glm::vec4 cameraPosition;
+	glm::vec4 lightPosition;
+	glm::vec4 lightColor;
+};
+static_assert(sizeof(FrameData) == 240, "FrameData must match the std140 block");
+
+// std140 layout of the ObjectData block, and of one instance in an instance
+// buffer. std140 pads each mat3 column to a vec4.
+struct ObjectData
+{
+	glm::mat4 model;
+	glm::vec4 normalMatrix[3];
+
+	// The normal matrix, transpose(inverse(mat3(model))), is computed here once
+	// rather than for every vertex
+	static ObjectData FromModel(const glm::mat4& model);
+};
+static_assert(sizeof(ObjectData) == 112, "ObjectData must match the std140 block");
+
+class UniformBuffer
+{
+public:
+	UniformBuffer(size_t size);
+	~UniformBuffer();
+
+	UniformBuffer(const UniformBuffer&) = delete;
+	UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+	// Replaces the whole buffer, growing it if needed. data may be null to orphan it.
+	void SetData(const void* data, size_t size);
+	void SetSubData(const void* data, size_t size, size_t offset);
+
+	void BindBase(unsigned int binding) const;
+	void BindRange(unsigned int binding, size_t offset, size_t size) const;
+
+	inline size_t GetSize() const { return m_Size; }
+
+	// Offsets passed to BindRange must be multiples of this
+	static size_t GetOffsetAlignment();
+	static size_t Align(size_t size);
+private:
+	unsigned int m_RendererID;
+	size_t m_Size;
+};
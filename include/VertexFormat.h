@@ -0,0 +1,82 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Mesh.h"
+#include "UniformBuffer.h"
+
+// 16-byte quantized vertex, half of Vertex. The vertex shader rebuilds the
+// position from the mesh bounds and unpacks the octahedral normal.
+struct CompactVertex
+{
+	uint16_t Position[4];  // unorm16 within the mesh bounds; w is padding
+	int16_t Normal[2];     // octahedral, snorm16
+	uint16_t TexCoords[2]; // half float
+};
+
+// Vertex and index data in the layout it is uploaded with. Data that needs
+// no conversion is referenced in place; anything converted lives in the
+// storage vectors.
+struct PackedMesh
+{
+	bool compact = false;
+	const void* vertexData = nullptr;
+	size_t vertexCount = 0;
+	const void* indexData = nullptr;
+	size_t indexCount = 0;
+	GLenum indexType = GL_UNSIGNED_INT;
+	std::vector<DrawRange> ranges;
+	std::vector<DrawLod> lods;
+	std::vector<Meshlet> meshlets;
+	glm::vec3 boundsMin = glm::vec3(0.0f);
+	glm::vec3 boundsMax = glm::vec3(0.0f);
+	glm::vec3 boundsCenter = glm::vec3(0.0f);
+	float boundsRadius = 0.0f;
+	glm::vec3 positionOffset = glm::vec3(0.0f);
+	glm::vec3 positionScale = glm::vec3(1.0f);
+	// VertexAttribute bits the source provided, which pick the shader variant
+	unsigned int attributes = VERTEX_ATTRIBUTE_ALL;
+
+	std::vector<unsigned char> vertexStorage;
+	std::vector<unsigned char> indexStorage;
+
+	inline size_t GetVertexSize() const { return compact ? sizeof(CompactVertex) : sizeof(Vertex); }
+	inline size_t GetIndexSize() const { return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t); }
+};
+
+// Chooses the GPU layout for a mesh. Indices become 16-bit whenever the mesh
+// has at most 65536 vertices. With compact vertices enabled, positions,
+// normals and UVs are quantized, and bigger meshes are cut into 16-bit
+// ranges sharing one buffer when the index savings outweigh the duplicated
+// border vertices.
+class VertexFormat
+{
+public:
+	// The source arrays must outlive the result, which may point into them.
+	// Without lods the whole index array is a single level.
+	static PackedMesh Pack(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount,
+		const MeshLod* lods = nullptr, size_t lodCount = 0);
+
+	// Attribute pointers for the VAO and vertex buffer currently bound
+	static void SetupAttributes(bool compact);
+	// Per-instance ObjectData: model matrix at locations 3-6 and normal matrix
+	// at 7-9, read from the bound array buffer starting at offset bytes
+	static void SetupInstanceAttributes(size_t offset);
+	// Fills buffer with one identity ObjectData and leaves it bound to
+	// GL_ARRAY_BUFFER. Non-instanced draws still fetch the instance
+	// attributes, so their instance buffer is never empty.
+	static void UploadIdentityInstance(unsigned int buffer);
+
+	static void SetCompact(bool compact);
+	static bool IsCompact();
+
+	static uint16_t FloatToHalf(float value);
+	static glm::vec2 EncodeOctahedral(const glm::vec3& normal);
+private:
+	static bool s_Compact;
+};
@@ -18,6 +18,18 @@ const float SPEED = 2.5f;
 const float SENSITIVITY = 0.1f;
 const float ZOOM = 45.0f;
 
+// Six planes (left, right, bottom, top, near, far) facing inwards, normalized
+// so plane distances are in the units of the space the matrix maps from
+struct Frustum
+{
+	glm::vec4 planes[6];
+
+	// Planes of a clip-space transform; pass projection * view * model to get them in object space
+	static Frustum FromMatrix(const glm::mat4& matrix);
+
+	bool IntersectsSphere(const glm::vec3& center, float radius) const;
+};
+
 class Camera
 {
 public:
@@ -36,6 +48,8 @@ public:
 	Camera(float posX, float posY, float posZ, float upX, float upY, float upZ, float yaw, float pitch);
 
 	glm::mat4 GetViewMatrix();
+	// World-space frustum of a perspective projection using zoom as the vertical field of view
+	Frustum GetFrustum(float aspect, float nearPlane, float farPlane);
 	void ProcessKeyboardEvent(CAMERA_MOVEMENT direction, float deltaTime);
 	void ProcessMouseEvent(float xOffset, float yOffset, GLboolean constrainPitch);
 	void ProcessMouseScroll(float yOffset);
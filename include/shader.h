@@ -5,19 +5,109 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
 
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtc/type_ptr.hpp"
 
+#include "Timer.h"
+
+// FNV-1a of a uniform or attribute name. constexpr, so SHADER_NAME() folds
+// literal names to constants and callers never build or hash strings per frame.
+constexpr uint32_t ShaderNameHash(const char* name, uint32_t hash = 2166136261u)
+{
+	return *name ? ShaderNameHash(name + 1, (hash ^ (uint32_t)(unsigned char)*name) * 16777619u) : hash;
+}
+
+#define SHADER_NAME(name) (std::integral_constant<uint32_t, ShaderNameHash(name)>::value)
+
+// Resolved location of a uniform of type T. Setting an invalid handle (a
+// uniform the program does not use) does nothing.
+template <typename T>
+struct ShaderUniform
+{
+	GLint location = -1;
+	inline bool isValid() const { return location >= 0; }
+};
+
+// Optional inputs a shader variant is specialized for. Each bit becomes a
+// #define (HAS_NORMALS, ...) ahead of the source.
+enum ShaderFeature
+{
+	SHADER_FEATURE_NORMALS = 1 << 0,
+	SHADER_FEATURE_TEXCOORDS = 1 << 1,
+	SHADER_FEATURE_DIFFUSE_MAP = 1 << 2,
+	SHADER_FEATURE_SPECULAR_MAP = 1 << 3,
+	SHADER_FEATURE_ALL = (1 << 4) - 1
+};
+
+enum ShaderStatus
+{
+	SHADER_STATUS_COMPILING = 0,
+	SHADER_STATUS_READY,
+	SHADER_STATUS_FAILED
+};
+
 class Shader
 {
 public:
 	unsigned int ID;
 
-	Shader();
+	// Loads a .shader file with "#shader vertex" and "#shader fragment"
+	// sections. #include "file" lines are resolved relative to the including
+	// file, and the linked program is kept in the ShaderCache.
+	//
+	// Compiling is only submitted: construct every program up front, then
+	// poll getStatus() and draw with something else until it is ready.
+	// Each define is inserted as "#define name" after the #version line.
+	Shader(const std::string& path, const std::vector<std::string>& defines = {});
+	~Shader();
+
+	Shader(const Shader&) = delete;
+	Shader& operator=(const Shader&) = delete;
+
+	// Never waits; uses KHR_parallel_shader_compile when the driver has it
+	ShaderStatus getStatus();
+	// Blocks until the program is built, for the fallback drawn meanwhile
+	void wait();
+	// The status as of the last poll
+	inline bool isReady() const { return m_Status == SHADER_STATUS_READY; }
+	// Submission to completed check, or the binary restore, once ready
+	inline double getBuildMs() const { return m_BuildMs; }
+	inline bool isRestored() const { return m_Restored; }
 
 	void use();
+
+	// Looks the name up in the table reflected at link time; no GL query
+	GLint getUniformLocation(uint32_t nameHash) const;
+	template <typename T>
+	ShaderUniform<T> getUniform(uint32_t nameHash) const { return { getUniformLocation(nameHash) }; }
+
+	void set(ShaderUniform<bool> uniform, bool value) const;
+	void set(ShaderUniform<int> uniform, int value) const;
+	void set(ShaderUniform<float> uniform, float value) const;
+	void set(ShaderUniform<glm::vec2> uniform, const glm::vec2& value) const;
+	void set(ShaderUniform<glm::vec3> uniform, const glm::vec3& value) const;
+	void set(ShaderUniform<glm::vec4> uniform, const glm::vec4& value) const;
+	void set(ShaderUniform<glm::mat2> uniform, const glm::mat2& mat) const;
+	void set(ShaderUniform<glm::mat3> uniform, const glm::mat3& mat) const;
+	void set(ShaderUniform<glm::mat4> uniform, const glm::mat4& mat) const;
+
+	// By hashed name, e.g. setMat4(SHADER_NAME("model"), m)
+	void setBool(uint32_t nameHash, bool value) const { set(getUniform<bool>(nameHash), value); }
+	void setInt(uint32_t nameHash, int value) const { set(getUniform<int>(nameHash), value); }
+	void setFloat(uint32_t nameHash, float value) const { set(getUniform<float>(nameHash), value); }
+	void setVec2(uint32_t nameHash, const glm::vec2& value) const { set(getUniform<glm::vec2>(nameHash), value); }
+	void setVec3(uint32_t nameHash, const glm::vec3& value) const { set(getUniform<glm::vec3>(nameHash), value); }
+	void setVec4(uint32_t nameHash, const glm::vec4& value) const { set(getUniform<glm::vec4>(nameHash), value); }
+	void setMat2(uint32_t nameHash, const glm::mat2& mat) const { set(getUniform<glm::mat2>(nameHash), mat); }
+	void setMat3(uint32_t nameHash, const glm::mat3& mat) const { set(getUniform<glm::mat3>(nameHash), mat); }
+	void setMat4(uint32_t nameHash, const glm::mat4& mat) const { set(getUniform<glm::mat4>(nameHash), mat); }
+
+	// By string, hashed at run time; for names that are not literals
 	void setBool(const std::string& name, bool value) const;
 	void setInt(const std::string& name, int value) const;
 	void setFloat(const std::string& name, float value) const;
@@ -30,6 +120,34 @@ public:
 	void setMat2(const std::string& name, const glm::mat2& mat) const;
 	void setMat3(const std::string& name, const glm::mat3& mat) const;
 	void setMat4(const std::string& name, const glm::mat4& mat) const;
+
+	// Bit n is set when the linked program reads the attribute at location n
+	unsigned int getActiveAttributeMask() const;
 private:
-	void checkCompileErrors(unsigned int shader, std::string type);
+	// Active uniforms and attributes, sorted by name hash. Array uniforms get
+	// one entry per element, named "name[i]".
+	struct Variable
+	{
+		uint32_t nameHash;
+		GLint location;
+		GLenum type;
+	};
+	std::vector<Variable> m_Uniforms;
+	std::vector<Variable> m_Attributes;
+
+	std::string m_Path;
+	std::string m_Name;
+	ShaderStatus m_Status;
+	unsigned int m_Vertex, m_Fragment;
+	uint64_t m_CacheKey;
+	unsigned int m_Polls;
+	Timer m_Timer;
+	double m_BuildMs;
+	bool m_Restored;
+
+	static void loadSource(const std::string& path, const std::vector<std::string>& defines, std::string& vertexSource, std::string& fragmentSource);
+	// Reads the compile and link results, then reflects and caches the program
+	void finish(bool restored);
+	bool checkCompileErrors(unsigned int shader, std::string type);
+	void reflect();
 };
\ No newline at end of file
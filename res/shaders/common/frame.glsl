@@ -0,0 +1,10 @@
+// Camera and light, written once per frame (FrameData in UniformBuffer.h)
+layout(std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    vec4 lightPosition;
+    vec4 lightColor;
+};
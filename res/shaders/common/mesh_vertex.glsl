@@ -0,0 +1,63 @@
+// Vertex stage shared by the programs that draw model meshes. HAS_NORMALS and
+// HAS_TEXCOORDS say whether the mesh's source provided those attributes.
+layout(location = 0) in vec3 aPos;
+#ifdef HAS_NORMALS
+layout(location = 1) in vec3 aNormal;
+#endif
+#ifdef HAS_TEXCOORDS
+layout(location = 2) in vec2 aTexCoord;
+#endif
+layout(location = 3) in mat4 aInstance;
+layout(location = 7) in mat3 aInstanceNormal;
+
+out vec3 FragPos;
+out vec3 Normal;
+#ifdef HAS_TEXCOORDS
+out vec2 TexCoord;
+#endif
+
+#include "frame.glsl"
+#include "object.glsl"
+
+// Instanced draws place each copy with model * aInstance
+uniform bool instanced = false;
+
+// Compact meshes store positions as unorm16 within their bounds and normals
+// as snorm16 octahedral pairs
+uniform vec3 positionOffset = vec3(0.0);
+uniform vec3 positionScale = vec3(1.0);
+uniform bool octahedralNormals = false;
+
+vec3 DecodeNormal(vec3 encoded)
+{
+    if (!octahedralNormals)
+        return encoded;
+    vec3 n = vec3(encoded.xy, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+void main()
+{
+    mat4 world = instanced ? model * aInstance : model;
+    mat3 worldNormal = instanced ? normalMatrix * aInstanceNormal : normalMatrix;
+    vec3 position = positionOffset + aPos * positionScale;
+#ifdef HAS_NORMALS
+    vec3 normal = DecodeNormal(aNormal);
+    // Degenerate faces can leave zero normals among valid ones
+    if (length(normal) < 0.1)
+        normal = vec3(0.0, 1.0, 0.0);
+#else
+    vec3 normal = vec3(0.0, 1.0, 0.0);
+#endif
+
+    vec4 worldPosition = world * vec4(position, 1.0);
+    FragPos = vec3(worldPosition);
+    Normal = worldNormal * normal;
+#ifdef HAS_TEXCOORDS
+    TexCoord = aTexCoord;
+#endif
+    gl_Position = viewProjection * worldPosition;
+}
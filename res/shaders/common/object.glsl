@@ -0,0 +1,7 @@
+// Per-object transform (ObjectData in UniformBuffer.h). normalMatrix is
+// transpose(inverse(mat3(model))), computed on the CPU.
+layout(std140) uniform ObjectData
+{
+    mat4 model;
+    mat3 normalMatrix;
+};
@@ -0,0 +1,27 @@
+#shader vertex
+#version 330 core
+// Meshes of every variant come through here; ones without normals read zeros
+#define HAS_NORMALS
+#include "common/mesh_vertex.glsl"
+
+#shader fragment
+#version 330 core
+
+// Flat diffuse shading, drawn while the real programs are still compiling
+
+out vec4 FragColor;
+
+in vec3 FragPos;
+in vec3 Normal;
+
+#include "common/frame.glsl"
+
+uniform vec3 objectColor = vec3(0.7, 0.7, 0.7);
+
+void main()
+{
+    vec3 norm = dot(Normal, Normal) > 0.0 ? normalize(Normal) : vec3(0.0, 1.0, 0.0);
+    vec3 lightDir = normalize(lightPosition.xyz - FragPos);
+    float diff = max(dot(norm, lightDir), 0.0);
+    FragColor = vec4((0.3 + diff) * lightColor.rgb * objectColor, 1.0);
+}
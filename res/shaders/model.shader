@@ -1,65 +1,55 @@
 #shader vertex
 #version 330 core
 
-layout(location = 0) in vec3 pos;
-layout(location = 1) in vec3 normal;
-layout(location = 2) in vec2 inTexCoord;
-
-out vec2 texCoord;
-out vec3 FragPos;
-out vec3 Normal;
-
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-void main()
-{
-    vec3 actualNormal = normal;
-    if (length(normal) < 0.1) {
-        actualNormal = vec3(0.0, 1.0, 0.0);
-    }
-    
-    FragPos = vec3(model * vec4(pos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * actualNormal;
-    texCoord = inTexCoord;
-    
-    gl_Position = projection * view * model * vec4(pos, 1.0);
-}
+#include "common/mesh_vertex.glsl"
 
 #shader fragment
 #version 330 core
 
 out vec4 FragColor;
 
-in vec2 texCoord;
 in vec3 FragPos;
 in vec3 Normal;
+#ifdef HAS_TEXCOORDS
+in vec2 TexCoord;
+#endif
 
-uniform sampler2D texture_diffuse1;
-uniform sampler2D texture1;
+#include "common/frame.glsl"
 
-uniform vec3 lightPos = vec3(1.2, 1.0, 2.0);
-uniform vec3 lightColor = vec3(1.0, 1.0, 1.0);
-uniform vec3 viewPos = vec3(0.0, 0.0, 3.0);
+#ifdef HAS_DIFFUSE_MAP
+uniform sampler2D texture_diffuse1;
+#endif
+#ifdef HAS_SPECULAR_MAP
+uniform sampler2D texture_specular1;
+#endif
+uniform vec3 objectColor = vec3(0.7, 0.7, 0.7);
 
 void main()
 {
-    vec4 texColor;
-    if (textureSize(texture_diffuse1, 0).x > 1) {
-        texColor = texture(texture_diffuse1, texCoord);
-    } else {
-        texColor = texture(texture1, texCoord);
-    }
-    
-    float ambientStrength = 1.0;
-    vec3 ambient = ambientStrength * lightColor;
+#ifdef HAS_DIFFUSE_MAP
+    vec4 baseColor = texture(texture_diffuse1, TexCoord);
+#else
+    vec4 baseColor = vec4(objectColor, 1.0);
+#endif
+#ifdef HAS_SPECULAR_MAP
+    float specularStrength = texture(texture_specular1, TexCoord).r;
+#else
+    float specularStrength = 0.5;
+#endif
+
+    float ambientStrength = 0.3;
+    vec3 ambient = ambientStrength * lightColor.rgb;
     
     vec3 norm = normalize(Normal);
-    vec3 lightDir = normalize(lightPos - FragPos);
+    vec3 lightDir = normalize(lightPosition.xyz - FragPos);
     float diff = max(dot(norm, lightDir), 0.0);
-    vec3 diffuse = diff * lightColor;
+    vec3 diffuse = diff * lightColor.rgb;
+    
+    vec3 viewDir = normalize(cameraPosition.xyz - FragPos);
+    vec3 reflectDir = reflect(-lightDir, norm);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
+    vec3 specular = specularStrength * spec * lightColor.rgb;
     
-    vec3 result = (ambient + diffuse) * texColor.rgb;
-    FragColor = vec4(result, texColor.a);
-}
\ No newline at end of file
+    vec3 result = (ambient + diffuse + specular) * baseColor.rgb;
+    FragColor = vec4(result, baseColor.a);
+}
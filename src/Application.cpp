@@ -4,14 +4,22 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <memory>
 
 #include "stb_image.h"
 #include "Shader.h"
+#include "ShaderVariants.h"
 #include "Camera.h"
 #include "Renderer.h"
+#include "Benchmark.h"
 #include "Model.h"
+#include "TextureCompressor.h"
+#include "VertexFormat.h"
+#include "Timer.h"
 
 #include "VertexBuffer.h"
 #include "IndexBuffer.h"
@@ -48,14 +56,62 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 void orbit_callback(GLFWwindow* window, double xPos, double yPos);
 void zoom_callback(GLFWwindow* window, double xOffset, double yOffset);
 void processInput(GLFWwindow* window);
-void DefaultCube(unsigned int& VAO, unsigned int& VBO, unsigned int& texture);
+void DefaultCube(unsigned int& VAO, unsigned int& VBO, unsigned int& instanceVBO, unsigned int& texture);
 
 int main(int argc, char* argv[])
 {
+    Timer startupTimer;
+
     std::string modelPath = "";
-    if (argc > 1)
+    bool benchMips = false;
+    bool benchCull = false;
+    bool backfaceCulling = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--assimp-obj")
+            Model::useNativeObj = false;
+        else if (arg == "--no-texture-compression")
+            TextureCompressor::SetEnabled(false);
+        else if (arg == "--compact")
+            VertexFormat::SetCompact(true);
+        else if (arg == "--bench-mips")
+            benchMips = true;
+        else if (arg == "--bench-cull")
+            benchCull = true;
+        else if (arg == "--backface-culling")
+            backfaceCulling = true;
+        else if (arg == "--no-cluster-culling")
+            Model::clusterCulling = false;
+        else if (arg == "--no-occlusion-culling")
+            Model::occlusionCulling = false;
+        else if (arg == "--no-geometry-arena")
+            Model::mergeGeometry = false;
+        else if (arg == "--lod-error" && i + 1 < argc)
+            Model::lodPixelError = std::max(0.0f, (float)std::atof(argv[++i]));
+        else if (arg == "--profile" && i + 1 < argc)
+        {
+            ImportProfile profile;
+            Model::importProfile = argv[++i];
+            if (!ImportProfile::Resolve(Model::importProfile, VERTEX_ATTRIBUTE_ALL, profile))
+            {
+                std::cout << "Unknown import profile '" << Model::importProfile << "' (expected " << ImportProfile::GetNames() << ")" << std::endl;
+                return -1;
+            }
+        }
+        else
+            modelPath = arg;
+    }
+
+    // Culling runs on the CPU only, so no window is needed
+    if (benchCull)
+    {
+        Benchmark::FrustumCulling(100000);
+        return 0;
+    }
+
+    if (!modelPath.empty())
     {
-        modelPath = argv[1];
         std::cout << "Loading model @: " << modelPath << std::endl;
     }
     else
@@ -69,6 +125,10 @@ int main(int argc, char* argv[])
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_RESIZABLE, GL_TRUE);
+#if MODELVIEWER_GL_CHECKS == 1
+    // Debug output is only guaranteed in a debug context
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+#endif
 
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
@@ -97,40 +157,57 @@ int main(int argc, char* argv[])
         return -1;
     }
 
-    glEnable(GL_DEPTH_TEST);
+    // Capabilities must be known before texture decodes pick a block format
+    Renderer::Init();
+
+    if (benchMips)
+    {
+        Benchmark::MipGeneration("res/tex");
+        Renderer::Shutdown();
+        glfwTerminate();
+        return 0;
+    }
 
-    // build and compile our shader program
-    Shader ourShader;
+    glEnable(GL_DEPTH_TEST);
+    // Models may be open or single-sided, so back faces are drawn unless asked otherwise
+    if (backfaceCulling)
+        Renderer::EnableFaceCulling();
+
+    // Variants of the model shader are compiled as meshes ask for them. The
+    // default cube's is submitted before anything waits, so the driver can
+    // compile it alongside the small fallback, which is the only program
+    // waited for and draws until a mesh's variant is ready.
+    const unsigned int cubeFeatures = SHADER_FEATURE_TEXCOORDS | SHADER_FEATURE_DIFFUSE_MAP;
+    std::unique_ptr<Shader> fallbackShader = std::make_unique<Shader>("res/shaders/fallback.shader");
+    std::unique_ptr<ShaderVariants> modelShaders = std::make_unique<ShaderVariants>("res/shaders/model.shader", *fallbackShader);
+    if (modelPath.empty())
+        modelShaders->Get(cubeFeatures);
+    fallbackShader->wait();
 
     std::unique_ptr<Model> model = nullptr;
-    unsigned int defaultVAO = 0, defaultVBO = 0, defaultTexture = 0;
+    unsigned int defaultVAO = 0, defaultVBO = 0, defaultInstanceVBO = 0, defaultTexture = 0;
     bool useModel = false;
 
+    // Import only computes the attributes some variant of the model shader reads
+    Model::vertexAttributes = ShaderVariants::GetVertexAttributes(SHADER_FEATURE_ALL);
+
+    // Import runs in the background; the render loop starts straight away
     if (!modelPath.empty())
     {
-        try
-        {
-            model = std::make_unique<Model>(modelPath);
-            useModel = true;
-            std::cout << "Model loaded successfully!" << std::endl;
-        }
-        catch(const std::exception& e)
-        {
-            std::cout << "Failed to load model: " << e.what() << std::endl;
-            std::cout << "Falling back to default cube." << std::endl;
-        }
+        model = std::make_unique<Model>(modelPath);
+        useModel = true;
     }
 
     if (!useModel)
     {
-        DefaultCube(defaultVAO, defaultVBO, defaultTexture);
+        DefaultCube(defaultVAO, defaultVBO, defaultInstanceVBO, defaultTexture);
     }
 
-    ourShader.use();
-    if (!useModel)
-    {
-        ourShader.setInt("texture1", 0);
-    }
+    bool firstFrame = true;
+    float lastStatsTime = 0.0f;
+    // Submission time over every frame, to compare GL error check modes
+    double submitMsTotal = 0.0;
+    size_t submitFrames = 0;
 
     {
         // Render loop
@@ -141,14 +218,28 @@ int main(int argc, char* argv[])
             lastFrame = currentFrame;
 
             processInput(window);
+            Renderer::ResetStats();
+
+            if (useModel && model)
+            {
+                model->Update();
+                if (model->HasFailed())
+                {
+                    std::cout << "Failed to load model: " << model->GetError() << std::endl;
+                    std::cout << "Falling back to default cube." << std::endl;
+                    model.reset();
+                    useModel = false;
+                    DefaultCube(defaultVAO, defaultVBO, defaultInstanceVBO, defaultTexture);
+                }
+            }
 
             GLCall(glClearColor(0.2f, 0.3f, 0.3f, 1.0f));
             GLCall(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
 
-            ourShader.use();
+            // The render loop never waits on a compile
+            modelShaders->Update();
 
             glm::mat4 projection = glm::perspective(glm::radians(fov), (float)WIDTH / (float)HEIGHT, 0.1f, 100.0f);
-            ourShader.setMat4("projection", projection);
 
             float horizontalDistance = cameraDistance * cos(cameraAngleY);
             float verticalDistance = cameraDistance * sin(cameraAngleY);
@@ -159,17 +250,28 @@ int main(int argc, char* argv[])
 
             glm::mat4 view = glm::lookAt(cameraPos, cameraTarget, glm::vec3(0.0f, 1.0f, 0.0f));
 
-            ourShader.setMat4("view", view);
+            // Camera and light for every program, in one upload
+            FrameData frame;
+            frame.view = view;
+            frame.projection = projection;
+            frame.viewProjection = projection * view;
+            frame.cameraPosition = glm::vec4(cameraPos, 1.0f);
+            frame.lightPosition = glm::vec4(2.0f, 4.0f, 2.0f, 1.0f);
+            frame.lightColor = glm::vec4(1.0f);
+            Renderer::SetFrameData(frame);
 
             if (useModel && model)
             {
                 glm::mat4 modelMatrix = glm::mat4(1.0f);
                 modelMatrix = glm::translate(modelMatrix, glm::vec3(0.0f, 0.0f, 0.0f));
-                ourShader.setMat4("model", modelMatrix);
-                model->Draw(ourShader);
+
+                ViewInfo viewInfo = { modelMatrix, view, projection, cameraPos, (float)HEIGHT };
+                model->Draw(*modelShaders, viewInfo);
             }
             else
             {
+                Shader& shader = modelShaders->Get(cubeFeatures);
+                shader.use();
                 GLCall(glActiveTexture(GL_TEXTURE0));
                 GLCall(glBindTexture(GL_TEXTURE_2D, defaultTexture));
                 GLCall(glBindVertexArray(defaultVAO));
@@ -187,30 +289,76 @@ int main(int argc, char* argv[])
                     glm::vec3(-1.3f,  1.0f, -1.5f)
                 };
 
+                ObjectData cubeTransforms[10];
                 for (unsigned int i = 0; i < 10; i++)
                 {
                     glm::mat4 modelMatrix = glm::mat4(1.0f);
                     modelMatrix = glm::translate(modelMatrix, cubePositions[i]);
                     float angle = 20.0f * (i + 1);
-                    modelMatrix = glm::rotate(modelMatrix, glm::radians(angle) * (float)glfwGetTime() / 2.0f, glm::vec3(1.0f, 0.3f, 0.5f));
-                    ourShader.setMat4("model", modelMatrix);
-
-                    GLCall(glDrawArrays(GL_TRIANGLES, 0, 36));
+                    cubeTransforms[i] = ObjectData::FromModel(glm::rotate(modelMatrix, glm::radians(angle) * (float)glfwGetTime() / 2.0f, glm::vec3(1.0f, 0.3f, 0.5f)));
                 }
+
+                // All ten cubes in one instanced draw
+                GLCall(glBindBuffer(GL_ARRAY_BUFFER, defaultInstanceVBO));
+                GLCall(glBufferData(GL_ARRAY_BUFFER, sizeof(cubeTransforms), cubeTransforms, GL_STREAM_DRAW));
+                Renderer::SetObjectTransform(glm::mat4(1.0f));
+                shader.setBool(SHADER_NAME("instanced"), true);
+                GLCall(glDrawArraysInstanced(GL_TRIANGLES, 0, 36, 10));
+                shader.setBool(SHADER_NAME("instanced"), false);
             }
 
             glfwSwapBuffers(window);
             glfwPollEvents();
+
+            if (useModel)
+            {
+                submitMsTotal += Renderer::GetStats().submitMs;
+                submitFrames++;
+            }
+
+            // The last frame's culling counters, shown a few times a second
+            if (useModel && currentFrame - lastStatsTime >= 0.25f)
+            {
+                const RenderStats& stats = Renderer::GetStats();
+                size_t visible = stats.clusters - stats.frustumCulledClusters - stats.backfaceCulledClusters;
+                char title[384];
+                std::snprintf(title, sizeof(title), "Model Viewer - %zu/%zu meshes (%zu occluded, %.2f ms), %zu/%zu clusters visible (%zu off-screen, %zu back-facing), %zu draws (%.2f ms, %zu state changes, %zu unsorted), %zu triangles",
+                    stats.meshes - stats.frustumCulledMeshes - stats.occludedMeshes, stats.meshes, stats.occludedMeshes, stats.occlusionMs,
+                    visible, stats.clusters, stats.frustumCulledClusters, stats.backfaceCulledClusters, stats.drawCalls, stats.submitMs,
+                    stats.stateChanges, stats.unsortedStateChanges, stats.triangles);
+                glfwSetWindowTitle(window, title);
+                lastStatsTime = currentFrame;
+            }
+
+            if (firstFrame)
+            {
+                std::cout << "Time to first frame: " << startupTimer.ElapsedMs() << " ms" << std::endl;
+                firstFrame = false;
+            }
         }
 
         if (!useModel)
         {
             GLCall(glDeleteVertexArrays(1, &defaultVAO));
             GLCall(glDeleteBuffers(1, &defaultVBO));
+            GLCall(glDeleteBuffers(1, &defaultInstanceVBO));
             GLCall(glDeleteTextures(1, &defaultTexture));
         }
     } // Scope allows index buffer to be deleted before the GLFW context is cleared
 
+    if (submitFrames > 0)
+    {
+        std::cout << "Submission: " << submitMsTotal / submitFrames << " ms per frame over " << submitFrames
+            << " frames, GL error checks " << Renderer::GetErrorCheckMode() << std::endl;
+    }
+    std::cout << modelShaders->GetVariantCount() << " shader variants, built in " << modelShaders->GetBuildMs() << " ms in total" << std::endl;
+
+    // GL objects go before the context does
+    model.reset();
+    modelShaders.reset();
+    fallbackShader.reset();
+    Renderer::Shutdown();
+
 	// Clear all GLFW resources
     glfwTerminate();
     return 0;
@@ -279,7 +427,7 @@ void processInput(GLFWwindow* window)
         glfwSetWindowShouldClose(window, true);
 }
 
-void DefaultCube(unsigned int& VAO, unsigned int& VBO, unsigned int& texture)
+void DefaultCube(unsigned int& VAO, unsigned int& VBO, unsigned int& instanceVBO, unsigned int& texture)
 {
     float vertices[] = {
         -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
@@ -340,6 +488,11 @@ void DefaultCube(unsigned int& VAO, unsigned int& VBO, unsigned int& texture)
     GLCall(glEnableVertexAttribArray(2));
     GLCall(glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float))));
 
+    // Per-cube transforms, filled every frame
+    GLCall(glGenBuffers(1, &instanceVBO));
+    GLCall(glBindBuffer(GL_ARRAY_BUFFER, instanceVBO));
+    VertexFormat::SetupInstanceAttributes(0);
+
     // Load default texture
     GLCall(glGenTextures(1, &texture));
     GLCall(glBindTexture(GL_TEXTURE_2D, texture));
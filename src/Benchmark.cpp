@@ -0,0 +1,174 @@
+#include "Benchmark.h"
+#include "FrustumCuller.h"
+#include "MipChain.h"
+#include "Renderer.h"
+#include "ThreadPool.h"
+#include "Timer.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace
+{
+	// Nearest-neighbour upscale keeping the source channel count
+	std::vector<unsigned char> Resize(const unsigned char* pixels, int width, int height, int channels, int size)
+	{
+		std::vector<unsigned char> result(static_cast<size_t>(size) * size * channels);
+		ThreadPool::Get().ParallelFor(static_cast<size_t>(size), [&](size_t begin, size_t end) {
+			for (size_t y = begin; y < end; y++)
+			{
+				const unsigned char* row = pixels + (y * height / size) * width * channels;
+				unsigned char* out = &result[y * size * channels];
+				for (int x = 0; x < size; x++)
+					for (int c = 0; c < channels; c++)
+						out[x * channels + c] = row[(static_cast<size_t>(x) * width / size) * channels + c];
+			}
+		}, 64);
+		return result;
+	}
+
+	double DriverMipmaps(const std::vector<unsigned char>& pixels, int size, int channels)
+	{
+		GLenum format = channels == 4 ? GL_RGBA : channels == 3 ? GL_RGB : GL_RED;
+		unsigned int texture;
+		GLCall(glGenTextures(1, &texture));
+		GLCall(glBindTexture(GL_TEXTURE_2D, texture));
+		GLCall(glFinish());
+
+		Timer timer;
+		GLCall(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+		GLCall(glTexImage2D(GL_TEXTURE_2D, 0, format, size, size, 0, format, GL_UNSIGNED_BYTE, pixels.data()));
+		GLCall(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+		GLCall(glGenerateMipmap(GL_TEXTURE_2D));
+		GLCall(glFinish());
+		double ms = timer.ElapsedMs();
+
+		GLCall(glDeleteTextures(1, &texture));
+		return ms;
+	}
+
+	// Returns expand + filter time; upload time goes to uploadMs
+	double CpuMipmaps(const std::vector<unsigned char>& pixels, int size, int channels, MipFilter filter, double& uploadMs)
+	{
+		Timer timer;
+		ImageRGBA8 rgba = MipChain::ExpandToRGBA(pixels.data(), size, size, channels);
+		std::vector<ImageRGBA8> levels = MipChain::Build(std::move(rgba), filter, true);
+		double buildMs = timer.ElapsedMs();
+
+		unsigned int texture;
+		GLCall(glGenTextures(1, &texture));
+		GLCall(glBindTexture(GL_TEXTURE_2D, texture));
+		GLCall(glFinish());
+
+		timer.Reset();
+		for (size_t level = 0; level < levels.size(); level++)
+		{
+			GLCall(glTexImage2D(GL_TEXTURE_2D, (GLint)level, GL_RGBA, levels[level].width, levels[level].height, 0, GL_RGBA, GL_UNSIGNED_BYTE, levels[level].pixels.data()));
+		}
+		GLCall(glFinish());
+		uploadMs = timer.ElapsedMs();
+
+		GLCall(glDeleteTextures(1, &texture));
+		return buildMs;
+	}
+
+	// Best of several runs, in ms; returns the number of visible boxes through visibleCount
+	double TimeCulling(const Frustum& frustum, const BoundsArray& bounds, std::vector<uint8_t>& visible, bool parallel, size_t& visibleCount)
+	{
+		double bestMs = 0.0;
+		for (int run = 0; run < 20; run++)
+		{
+			Timer timer;
+			FrustumCuller::Cull(frustum, bounds, visible.data(), parallel);
+			double ms = timer.ElapsedMs();
+			bestMs = run == 0 ? ms : std::min(bestMs, ms);
+		}
+		visibleCount = std::count(visible.begin(), visible.begin() + bounds.count, 1);
+		return bestMs;
+	}
+}
+
+void Benchmark::MipGeneration(const std::string& directory)
+{
+	const char* simd = MipChain::GetInstructionSet();
+	std::cout << "=== Mip generation benchmark (" << directory << ", " << ThreadPool::Get().GetThreadCount()
+		<< " threads, " << simd << ") ===" << std::endl;
+	std::cout << std::fixed << std::setprecision(1);
+
+	std::error_code error;
+	for (const auto& file : std::filesystem::directory_iterator(directory, error))
+	{
+		int width, height, channels;
+		unsigned char* data = stbi_load(file.path().string().c_str(), &width, &height, &channels, 0);
+		if (!data)
+			continue;
+
+		for (int size : { 4096, 8192 })
+		{
+			std::vector<unsigned char> pixels = Resize(data, width, height, channels, size);
+
+			double uploadMs = 0.0;
+			double driverMs = DriverMipmaps(pixels, size, channels);
+			MipChain::SetSimdEnabled(false);
+			double scalarBoxMs = CpuMipmaps(pixels, size, channels, MIP_FILTER_BOX, uploadMs);
+			MipChain::SetSimdEnabled(true);
+			double boxMs = CpuMipmaps(pixels, size, channels, MIP_FILTER_BOX, uploadMs);
+			double kaiserMs = CpuMipmaps(pixels, size, channels, MIP_FILTER_KAISER, uploadMs);
+
+			std::cout << file.path().filename().string() << " @ " << size << "x" << size << " (" << channels << " ch)\n"
+				<< "  glGenerateMipmap (upload + generate): " << driverMs << " ms\n"
+				<< "  CPU box, scalar: " << scalarBoxMs << " ms\n"
+				<< "  CPU box, " << simd << ": " << boxMs << " ms\n"
+				<< "  CPU Kaiser, " << simd << ": " << kaiserMs << " ms\n"
+				<< "  Explicit upload of all levels: " << uploadMs << " ms" << std::endl;
+		}
+		stbi_image_free(data);
+	}
+}
+
+void Benchmark::FrustumCulling(size_t boxCount)
+{
+	const char* simd = FrustumCuller::GetInstructionSet();
+	std::cout << "=== Frustum culling benchmark (" << ThreadPool::Get().GetThreadCount() << " threads, " << simd << ") ===" << std::endl;
+	std::cout << std::fixed << std::setprecision(3);
+
+	// Camera at the origin looking down -z into a cube of scattered boxes
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 500.0f);
+	Frustum frustum = Frustum::FromMatrix(projection);
+
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> position(-200.0f, 200.0f);
+	std::uniform_real_distribution<float> extent(0.1f, 4.0f);
+
+	for (size_t count : { boxCount, boxCount * 10 })
+	{
+		BoundsArray bounds;
+		bounds.Reserve(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			glm::vec3 center(position(random), position(random), position(random));
+			glm::vec3 half(extent(random), extent(random), extent(random));
+			bounds.Add(center - half, center + half);
+		}
+		std::vector<uint8_t> visible(bounds.GetPaddedCount());
+
+		size_t scalarVisible, simdVisible, parallelVisible;
+		FrustumCuller::SetSimdEnabled(false);
+		double scalarMs = TimeCulling(frustum, bounds, visible, false, scalarVisible);
+		FrustumCuller::SetSimdEnabled(true);
+		double simdMs = TimeCulling(frustum, bounds, visible, false, simdVisible);
+		double parallelMs = TimeCulling(frustum, bounds, visible, true, parallelVisible);
+
+		auto rate = [count](double ms) { return ms > 0.0 ? count / (ms * 1000.0) : 0.0; };
+		std::cout << count << " boxes, " << simdVisible << " visible"
+			<< (scalarVisible == simdVisible && simdVisible == parallelVisible ? "" : " (MISMATCH)") << "\n"
+			<< "  scalar: " << scalarMs << " ms (" << rate(scalarMs) << " M boxes/s)\n"
+			<< "  " << simd << ": " << simdMs << " ms (" << rate(simdMs) << " M boxes/s)\n"
+			<< "  " << simd << " + thread pool: " << parallelMs << " ms (" << rate(parallelMs) << " M boxes/s)" << std::endl;
+	}
+}
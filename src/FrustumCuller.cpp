@@ -0,0 +1,172 @@
+#include "FrustumCuller.h"
+#include "ThreadPool.h"
+
+#include <limits>
+
+#if defined(__AVX__)
+#define FRUSTUMCULLER_AVX 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUMCULLER_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// Coordinates of the corner furthest along each plane's normal
+	struct PlaneCorners
+	{
+		const float* x;
+		const float* y;
+		const float* z;
+	};
+
+	void SelectCorners(const Frustum& frustum, const BoundsArray& bounds, PlaneCorners* corners)
+	{
+		for (int p = 0; p < 6; p++)
+		{
+			const glm::vec4& plane = frustum.planes[p];
+			corners[p].x = plane.x >= 0.0f ? bounds.maxX.data() : bounds.minX.data();
+			corners[p].y = plane.y >= 0.0f ? bounds.maxY.data() : bounds.minY.data();
+			corners[p].z = plane.z >= 0.0f ? bounds.maxZ.data() : bounds.minZ.data();
+		}
+	}
+
+	void CullScalar(const Frustum& frustum, const PlaneCorners* corners, size_t begin, size_t end, uint8_t* visible)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			bool inside = true;
+			for (int p = 0; p < 6 && inside; p++)
+			{
+				const glm::vec4& plane = frustum.planes[p];
+				inside = plane.x * corners[p].x[i] + plane.y * corners[p].y[i] + plane.z * corners[p].z[i] + plane.w >= 0.0f;
+			}
+			visible[i] = inside ? 1 : 0;
+		}
+	}
+
+#if FRUSTUMCULLER_SSE
+	void CullSSE(const Frustum& frustum, const PlaneCorners* corners, size_t begin, size_t end, uint8_t* visible)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		for (size_t i = begin; i < end; i += 4)
+		{
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (int p = 0; p < 6; p++)
+			{
+				const glm::vec4& plane = frustum.planes[p];
+				__m128 distance = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), _mm_loadu_ps(corners[p].x + i)),
+					_mm_mul_ps(_mm_set1_ps(plane.y), _mm_loadu_ps(corners[p].y + i)));
+				distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.z), _mm_loadu_ps(corners[p].z + i)));
+				distance = _mm_add_ps(distance, _mm_set1_ps(plane.w));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, zero));
+			}
+			int mask = _mm_movemask_ps(inside);
+			for (int k = 0; k < 4; k++)
+				visible[i + k] = static_cast<uint8_t>((mask >> k) & 1);
+		}
+	}
+#endif
+
+#if FRUSTUMCULLER_AVX
+	void CullAVX(const Frustum& frustum, const PlaneCorners* corners, size_t begin, size_t end, uint8_t* visible)
+	{
+		const __m256 zero = _mm256_setzero_ps();
+		for (size_t i = begin; i < end; i += 8)
+		{
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (int p = 0; p < 6; p++)
+			{
+				const glm::vec4& plane = frustum.planes[p];
+				__m256 distance = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), _mm256_loadu_ps(corners[p].x + i)),
+					_mm256_mul_ps(_mm256_set1_ps(plane.y), _mm256_loadu_ps(corners[p].y + i)));
+				distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane.z), _mm256_loadu_ps(corners[p].z + i)));
+				distance = _mm256_add_ps(distance, _mm256_set1_ps(plane.w));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, zero, _CMP_GE_OQ));
+			}
+			int mask = _mm256_movemask_ps(inside);
+			for (int k = 0; k < 8; k++)
+				visible[i + k] = static_cast<uint8_t>((mask >> k) & 1);
+		}
+	}
+#endif
+}
+
+void BoundsArray::Clear()
+{
+	minX.clear(); minY.clear(); minZ.clear();
+	maxX.clear(); maxY.clear(); maxZ.clear();
+	count = 0;
+}
+
+void BoundsArray::Reserve(size_t capacity)
+{
+	capacity = (capacity + kBlockSize - 1) / kBlockSize * kBlockSize;
+	minX.reserve(capacity); minY.reserve(capacity); minZ.reserve(capacity);
+	maxX.reserve(capacity); maxY.reserve(capacity); maxZ.reserve(capacity);
+}
+
+void BoundsArray::Add(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	// Padding boxes are inverted so they never pass a plane test
+	if (count == minX.size())
+	{
+		const float lowest = std::numeric_limits<float>::lowest();
+		const float highest = std::numeric_limits<float>::max();
+		size_t padded = minX.size() + kBlockSize;
+		minX.resize(padded, highest); minY.resize(padded, highest); minZ.resize(padded, highest);
+		maxX.resize(padded, lowest); maxY.resize(padded, lowest); maxZ.resize(padded, lowest);
+	}
+
+	minX[count] = boundsMin.x; minY[count] = boundsMin.y; minZ[count] = boundsMin.z;
+	maxX[count] = boundsMax.x; maxY[count] = boundsMax.y; maxZ[count] = boundsMax.z;
+	count++;
+}
+
+bool FrustumCuller::s_SimdEnabled = true;
+
+void FrustumCuller::SetSimdEnabled(bool enabled)
+{
+	s_SimdEnabled = enabled;
+}
+
+const char* FrustumCuller::GetInstructionSet()
+{
+#if FRUSTUMCULLER_AVX
+	return s_SimdEnabled ? "AVX" : "scalar";
+#elif FRUSTUMCULLER_SSE
+	return s_SimdEnabled ? "SSE" : "scalar";
+#else
+	return "scalar";
+#endif
+}
+
+void FrustumCuller::Cull(const Frustum& frustum, const BoundsArray& bounds, uint8_t* visible, bool parallel)
+{
+	PlaneCorners corners[6];
+	SelectCorners(frustum, bounds, corners);
+
+	auto cullRange = [&](size_t begin, size_t end) {
+#if FRUSTUMCULLER_AVX
+		if (s_SimdEnabled)
+			return CullAVX(frustum, corners, begin, end, visible);
+#elif FRUSTUMCULLER_SSE
+		if (s_SimdEnabled)
+			return CullSSE(frustum, corners, begin, end, visible);
+#endif
+		CullScalar(frustum, corners, begin, end, visible);
+	};
+
+	size_t blocks = bounds.GetPaddedCount() / BoundsArray::kBlockSize;
+	if (!parallel || bounds.count < kParallelThreshold)
+	{
+		cullRange(0, bounds.GetPaddedCount());
+		return;
+	}
+
+	// Model::Draw culls on the GL thread, which must not pick up import jobs
+	ThreadPool::Get().ParallelForIsolated(blocks, [&](size_t begin, size_t end) {
+		cullRange(begin * BoundsArray::kBlockSize, end * BoundsArray::kBlockSize);
+	}, kParallelThreshold / BoundsArray::kBlockSize / 2);
+}
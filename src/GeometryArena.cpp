@@ -0,0 +1,116 @@
+#include "GeometryArena.h"
+
+#include "Renderer.h"
+#include "VertexFormat.h"
+
+#include <algorithm>
+#include <cstdint>
+
+GeometryArena::GeometryArena(bool compact, GLenum indexType)
+	: m_Compact(compact), m_IndexType(indexType), m_VAO(0), m_VBO(0), m_EBO(0), m_InstanceVBO(0),
+	  m_VertexCount(0), m_VertexCapacity(0), m_IndexCount(0), m_IndexCapacity(0)
+{
+	GLCall(glGenVertexArrays(1, &m_VAO));
+	GLCall(glGenBuffers(1, &m_VBO));
+	GLCall(glGenBuffers(1, &m_EBO));
+	GLCall(glGenBuffers(1, &m_InstanceVBO));
+	VertexFormat::UploadIdentityInstance(m_InstanceVBO);
+
+	SetupVertexArray();
+}
+
+GeometryArena::~GeometryArena()
+{
+	GLCall(glDeleteVertexArrays(1, &m_VAO));
+	GLCall(glDeleteBuffers(1, &m_VBO));
+	GLCall(glDeleteBuffers(1, &m_EBO));
+	GLCall(glDeleteBuffers(1, &m_InstanceVBO));
+}
+
+size_t GeometryArena::GetVertexSize() const
+{
+	return m_Compact ? sizeof(CompactVertex) : sizeof(Vertex);
+}
+
+size_t GeometryArena::GetIndexSize() const
+{
+	return m_IndexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+size_t GeometryArena::GetBytes() const
+{
+	return m_VertexCount * GetVertexSize() + m_IndexCount * GetIndexSize();
+}
+
+void GeometryArena::Add(const void* vertexData, size_t vertexCount, const void* indexData, size_t indexCount,
+	size_t& firstVertex, size_t& indexByteOffset)
+{
+	// Start at 64K vertices and 256K indices, then double
+	const size_t kMinVertices = 1 << 16;
+	const size_t kMinIndices = 1 << 18;
+
+	size_t vertexSize = GetVertexSize();
+	size_t indexSize = GetIndexSize();
+
+	if (m_VertexCount + vertexCount > m_VertexCapacity || m_IndexCount + indexCount > m_IndexCapacity)
+	{
+		size_t vertexCapacity = std::max(m_VertexCapacity, kMinVertices);
+		while (vertexCapacity < m_VertexCount + vertexCount)
+			vertexCapacity *= 2;
+		size_t indexCapacity = std::max(m_IndexCapacity, kMinIndices);
+		while (indexCapacity < m_IndexCount + indexCount)
+			indexCapacity *= 2;
+
+		if (vertexCapacity != m_VertexCapacity)
+			Grow(m_VBO, m_VertexCount * vertexSize, vertexCapacity * vertexSize);
+		if (indexCapacity != m_IndexCapacity)
+			Grow(m_EBO, m_IndexCount * indexSize, indexCapacity * indexSize);
+		m_VertexCapacity = vertexCapacity;
+		m_IndexCapacity = indexCapacity;
+
+		// The VAO still refers to the old buffer names
+		SetupVertexArray();
+	}
+
+	firstVertex = m_VertexCount;
+	indexByteOffset = m_IndexCount * indexSize;
+
+	GLCall(glBindBuffer(GL_ARRAY_BUFFER, m_VBO));
+	GLCall(glBufferSubData(GL_ARRAY_BUFFER, m_VertexCount * vertexSize, vertexCount * vertexSize, vertexData));
+	// The element binding is VAO state, so the copy goes through a generic target
+	GLCall(glBindBuffer(GL_COPY_WRITE_BUFFER, m_EBO));
+	GLCall(glBufferSubData(GL_COPY_WRITE_BUFFER, indexByteOffset, indexCount * indexSize, indexData));
+	GLCall(glBindBuffer(GL_COPY_WRITE_BUFFER, 0));
+
+	m_VertexCount += vertexCount;
+	m_IndexCount += indexCount;
+}
+
+void GeometryArena::Grow(unsigned int& buffer, size_t usedBytes, size_t newBytes)
+{
+	unsigned int grown;
+	GLCall(glGenBuffers(1, &grown));
+	GLCall(glBindBuffer(GL_COPY_WRITE_BUFFER, grown));
+	GLCall(glBufferData(GL_COPY_WRITE_BUFFER, newBytes, nullptr, GL_STATIC_DRAW));
+	if (usedBytes > 0)
+	{
+		GLCall(glBindBuffer(GL_COPY_READ_BUFFER, buffer));
+		GLCall(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes));
+		GLCall(glBindBuffer(GL_COPY_READ_BUFFER, 0));
+	}
+	GLCall(glBindBuffer(GL_COPY_WRITE_BUFFER, 0));
+
+	GLCall(glDeleteBuffers(1, &buffer));
+	buffer = grown;
+}
+
+void GeometryArena::SetupVertexArray()
+{
+	GLCall(glBindVertexArray(m_VAO));
+	GLCall(glBindBuffer(GL_ARRAY_BUFFER, m_VBO));
+	VertexFormat::SetupAttributes(m_Compact);
+	GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO));
+	GLCall(glBindBuffer(GL_ARRAY_BUFFER, m_InstanceVBO));
+	VertexFormat::SetupInstanceAttributes(0);
+	GLCall(glBindVertexArray(0));
+}
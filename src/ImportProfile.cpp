@@ -0,0 +1,69 @@
+#include "ImportProfile.h"
+#include "Mesh.h"
+
+#include <assimp/config.h>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+
+bool ImportProfile::Resolve(const std::string& name, unsigned int vertexAttributes, ImportProfile& out)
+{
+	int level;
+	if (name == "fast-preview")
+		level = 0;
+	else if (name == "balanced")
+		level = 1;
+	else if (name == "max-optimize")
+		level = 2;
+	else
+		return false;
+
+	bool normals = (vertexAttributes & VERTEX_ATTRIBUTE_NORMAL) != 0;
+	bool texCoords = (vertexAttributes & VERTEX_ATTRIBUTE_TEXCOORD) != 0;
+
+	out.name = name;
+	out.flags = aiProcess_Triangulate | aiProcess_RemoveComponent;
+
+	// Vertex has no tangents, colours or bone weights, so none are kept
+	out.removeComponents = aiComponent_TANGENTS_AND_BITANGENTS | aiComponent_COLORS | aiComponent_BONEWEIGHTS
+		| aiComponent_ANIMATIONS | aiComponent_CAMERAS | aiComponent_LIGHTS;
+	if (!normals)
+		out.removeComponents |= aiComponent_NORMALS;
+	if (!texCoords)
+		out.removeComponents |= aiComponent_TEXCOORDS;
+	else
+		out.flags |= aiProcess_FlipUVs;
+
+	// Either step only runs for meshes that have no normals yet
+	if (normals)
+		out.flags |= level == 0 ? aiProcess_GenNormals : aiProcess_GenSmoothNormals;
+
+	if (level >= 1)
+	{
+		out.flags |= aiProcess_JoinIdenticalVertices | aiProcess_SortByPType
+			| aiProcess_RemoveRedundantMaterials;
+		out.removePrimitives = aiPrimitiveType_POINT | aiPrimitiveType_LINE;
+	}
+
+	if (level >= 2)
+	{
+		out.flags |= aiProcess_OptimizeMeshes | aiProcess_OptimizeGraph | aiProcess_FindDegenerates
+			| aiProcess_FindInvalidData;
+		if (texCoords)
+			out.flags |= aiProcess_GenUVCoords;
+	}
+	return true;
+}
+
+const char* ImportProfile::GetNames()
+{
+	return "fast-preview, balanced, max-optimize";
+}
+
+void ImportProfile::Configure(Assimp::Importer& importer) const
+{
+	importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, removeComponents);
+	if (removePrimitives)
+		importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, removePrimitives);
+	if (flags & aiProcess_FindDegenerates)
+		importer.SetPropertyBool(AI_CONFIG_PP_FD_REMOVE, true);
+}
@@ -1,61 +1,71 @@
 #include "Mesh.h"
+#include "GeometryArena.h"
 #include "Renderer.h"
+#include "VertexFormat.h"
+
+#include <algorithm>
 
 Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures)
 {
-	this->vertices = vertices;
-	this->indices = indices;
-	this->textures = textures;
-	InitMesh();
+	this->vertices = std::move(vertices);
+	this->indices = std::move(indices);
+	this->textures = std::move(textures);
+	InitMesh(VertexFormat::Pack(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size()), nullptr);
 }
 
-void Mesh::InitMesh()
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<MeshLod> lods, std::vector<Texture> textures,
+	const PackedMesh& packed, GeometryArena* arena)
 {
-    GLCall(glGenVertexArrays(1, &VAO));
-    GLCall(glGenBuffers(1, &VBO));
-    GLCall(glGenBuffers(1, &EBO));
-
-    GLCall(glBindVertexArray(VAO));
-
-    GLCall(glBindBuffer(GL_ARRAY_BUFFER, VBO));
-    GLCall(glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW));
-
-    GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO));
-    GLCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW));
-
-    GLCall(glEnableVertexAttribArray(0));
-    GLCall(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0));
+	this->vertices = std::move(vertices);
+	this->indices = std::move(indices);
+	this->lods = std::move(lods);
+	this->textures = std::move(textures);
+	InitMesh(packed, arena);
+}
 
-    if (vertices.size() > 0 && vertices[0].Normal != glm::vec3(0.0f)) {
-        GLCall(glEnableVertexAttribArray(1));
-        GLCall(glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal)));
-    }
+Mesh::Mesh(const PackedMesh& packed, std::vector<Texture> textures, GeometryArena* arena)
+{
+	this->textures = std::move(textures);
+	InitMesh(packed, arena);
+}
 
-    if (!vertices.empty() && (vertices[0].TexCoords.x != 0.0f || vertices[0].TexCoords.y != 0.0f))
+void DrawList::Add(size_t indexCount, size_t byteOffset, size_t indexSize, GLint baseVertex)
+{
+    if (!counts.empty() && end == byteOffset && baseVertices.back() == baseVertex)
+        counts.back() += (GLsizei)indexCount;
+    else
     {
-        GLCall(glEnableVertexAttribArray(2));
-        GLCall(glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords)));
+        counts.push_back((GLsizei)indexCount);
+        offsets.push_back((const void*)byteOffset);
+        baseVertices.push_back(baseVertex);
     }
-
-    GLCall(glBindVertexArray(0));
-
-    std::cout << "Mesh initialized with " << vertices.size() << " vertices and "
-        << indices.size() << " indices" << std::endl;
+    end = byteOffset + indexCount * indexSize;
 }
 
-void Mesh::Draw(Shader& shader)
+void Mesh::InitMesh(const PackedMesh& packed, GeometryArena* arena)
 {
+    indexType = packed.indexType;
+    ranges = packed.ranges;
+    lodLevels = packed.lods;
+    meshlets = packed.meshlets;
+    currentLod = 0;
+    boundsCenter = packed.boundsCenter;
+    boundsRadius = packed.boundsRadius;
+    compact = packed.compact;
+    positionOffset = packed.positionOffset;
+    positionScale = packed.positionScale;
+    attributes = packed.attributes;
+
+    // Sampler names are numbered per texture type: texture_diffuse1, texture_diffuse2, ...
     unsigned int diffuseNr = 1;
     unsigned int specularNr = 1;
     unsigned int normalNr = 1;
     unsigned int heightNr = 1;
-
-    for (unsigned int i = 0; i < textures.size(); i++)
+    textureUniforms.clear();
+    for (const Texture& texture : textures)
     {
-        GLCall(glActiveTexture(GL_TEXTURE0 + i));
-
         std::string number;
-        std::string name = textures[i].type;
+        const std::string& name = texture.type;
         if (name == "texture_diffuse")
             number = std::to_string(diffuseNr++);
         else if (name == "texture_specular")
@@ -64,14 +74,250 @@ void Mesh::Draw(Shader& shader)
             number = std::to_string(normalNr++);
         else if (name == "texture_height")
             number = std::to_string(heightNr++);
+        textureUniforms.push_back(ShaderNameHash((name + number).c_str()));
+    }
+
+    // Maps are only sampled through UVs, so they need the texcoord attribute
+    shaderFeatures = 0;
+    if (attributes & VERTEX_ATTRIBUTE_NORMAL)
+        shaderFeatures |= SHADER_FEATURE_NORMALS;
+    if (attributes & VERTEX_ATTRIBUTE_TEXCOORD)
+    {
+        shaderFeatures |= SHADER_FEATURE_TEXCOORDS;
+        if (diffuseNr > 1)
+            shaderFeatures |= SHADER_FEATURE_DIFFUSE_MAP;
+        if (specularNr > 1)
+            shaderFeatures |= SHADER_FEATURE_SPECULAR_MAP;
+    }
+
+    size_t vertexBytes = packed.vertexCount * packed.GetVertexSize();
+    size_t indexBytes = packed.indexCount * packed.GetIndexSize();
+    gpuBytes = vertexBytes + indexBytes;
 
-        GLCall(glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i));
+    if (arena)
+    {
+        VAO = arena->GetVertexArray();
+        VBO = EBO = 0;
+        instanceVBO = arena->GetInstanceBuffer();
+        arena->Add(packed.vertexData, packed.vertexCount, packed.indexData, packed.indexCount, firstVertex, indexByteOffset);
+    }
+    else
+    {
+        firstVertex = 0;
+        indexByteOffset = 0;
+
+        GLCall(glGenVertexArrays(1, &VAO));
+        GLCall(glGenBuffers(1, &VBO));
+        GLCall(glGenBuffers(1, &EBO));
+
+        GLCall(glBindVertexArray(VAO));
+
+        GLCall(glBindBuffer(GL_ARRAY_BUFFER, VBO));
+        GLCall(glBufferData(GL_ARRAY_BUFFER, vertexBytes, packed.vertexData, GL_STATIC_DRAW));
+
+        GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO));
+        GLCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, packed.indexData, GL_STATIC_DRAW));
+
+        VertexFormat::SetupAttributes(compact);
+
+        GLCall(glGenBuffers(1, &instanceVBO));
+        VertexFormat::UploadIdentityInstance(instanceVBO);
+        VertexFormat::SetupInstanceAttributes(0);
+
+        GLCall(glBindVertexArray(0));
+    }
+
+    std::cout << "Mesh initialized with " << packed.vertexCount << " vertices and "
+        << packed.indexCount << " indices (" << (compact ? "compact" : "full") << " vertices, "
+        << (indexType == GL_UNSIGNED_SHORT ? 16 : 32) << "-bit indices, " << ranges.size() << " draw ranges, " << lodLevels.size() << " LODs, " << meshlets.size() << " meshlets)" << std::endl;
+}
+
+size_t Mesh::SelectLod(const ViewInfo& view, float pixelError, size_t current) const
+{
+    // A coarser level must beat the threshold by this factor before it is used
+    const float kHysteresis = 0.75f;
+
+    if (lodLevels.size() <= 1)
+        return 0;
+
+    float scale = std::max(glm::length(glm::vec3(view.model[0])), std::max(glm::length(glm::vec3(view.model[1])), glm::length(glm::vec3(view.model[2]))));
+    glm::vec3 center = glm::vec3(view.model * glm::vec4(boundsCenter, 1.0f));
+    float distance = glm::length(center - view.cameraPosition) - boundsRadius * scale;
+    if (distance <= 0.0f)
+        return 0;
+
+    // World units to pixels at the nearest point of the bounding sphere
+    float pixelsPerUnit = view.viewportHeight * view.projection[1][1] / (2.0f * distance);
+    size_t target = 0;
+    for (size_t i = 1; i < lodLevels.size(); i++)
+    {
+        if (lodLevels[i].error * scale * pixelsPerUnit <= pixelError)
+            target = i;
+    }
+    while (target > current && lodLevels[target].error * scale * pixelsPerUnit > pixelError * kHysteresis)
+        target--;
+    return target;
+}
+
+size_t Mesh::GetTriangleCount(size_t level) const
+{
+    const DrawLod& lod = lodLevels[level];
+    size_t indexCount = 0;
+    for (size_t i = lod.firstRange; i < lod.firstRange + lod.rangeCount; i++)
+        indexCount += ranges[i].indexCount;
+    return indexCount / 3;
+}
+
+void Mesh::BindMaterial(Shader& shader)
+{
+    for (unsigned int i = 0; i < textures.size(); i++)
+    {
+        GLCall(glActiveTexture(GL_TEXTURE0 + i));
+        shader.setInt(textureUniforms[i], i);
         GLCall(glBindTexture(GL_TEXTURE_2D, textures[i].id));
     }
+    // Otherwise the samplers would read the previous material's texture
+    if (textures.empty())
+    {
+        GLCall(glActiveTexture(GL_TEXTURE0));
+        GLCall(glBindTexture(GL_TEXTURE_2D, 0));
+    }
+
+    // Compact positions are stored relative to the mesh bounds
+    shader.setVec3(SHADER_NAME("positionOffset"), positionOffset);
+    shader.setVec3(SHADER_NAME("positionScale"), positionScale);
+    shader.setBool(SHADER_NAME("octahedralNormals"), compact);
 
+    GLCall(glActiveTexture(GL_TEXTURE0));
+}
+
+void Mesh::Draw(Shader& shader)
+{
+    drawList.Clear();
+    Gather(drawList);
+    if (drawList.IsEmpty())
+        return;
+
+    BindMaterial(shader);
     GLCall(glBindVertexArray(VAO));
-    GLCall(glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0));
+    SubmitRuns(drawList.counts.data(), drawList.offsets.data(), drawList.baseVertices.data(), drawList.counts.size());
     GLCall(glBindVertexArray(0));
+}
 
-    GLCall(glActiveTexture(GL_TEXTURE0));
-}
\ No newline at end of file
+void Mesh::Draw(Shader& shader, const Frustum& frustum, const glm::vec3& cameraPosition)
+{
+    drawList.Clear();
+    Gather(drawList, frustum, cameraPosition);
+    if (drawList.IsEmpty())
+        return;
+
+    BindMaterial(shader);
+    GLCall(glBindVertexArray(VAO));
+    SubmitRuns(drawList.counts.data(), drawList.offsets.data(), drawList.baseVertices.data(), drawList.counts.size());
+    GLCall(glBindVertexArray(0));
+}
+
+void Mesh::Gather(DrawList& list)
+{
+    RenderStats& stats = Renderer::GetStats();
+    size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+    const DrawLod& lod = lodLevels[currentLod];
+    for (size_t i = lod.firstRange; i < lod.firstRange + lod.rangeCount; i++)
+    {
+        const DrawRange& range = ranges[i];
+        list.Add(range.indexCount, indexByteOffset + range.indexOffset * indexSize, indexSize, (GLint)(firstVertex + range.baseVertex));
+        stats.triangles += range.indexCount / 3;
+    }
+}
+
+void Mesh::Gather(DrawList& list, const Frustum& frustum, const glm::vec3& cameraPosition)
+{
+    RenderStats& stats = Renderer::GetStats();
+    size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+
+    // Meshlets are stored in index order, so neighbouring visible ones merge into one run
+    const DrawLod& lod = lodLevels[currentLod];
+    for (size_t i = lod.firstMeshlet; i < lod.firstMeshlet + lod.meshletCount; i++)
+    {
+        const Meshlet& meshlet = meshlets[i];
+        if (!frustum.IntersectsSphere(meshlet.center, meshlet.radius))
+        {
+            stats.frustumCulledClusters++;
+            continue;
+        }
+        // Skipping back-facing meshlets is only invisible when GL would cull their triangles anyway
+        if (Renderer::IsFaceCullingEnabled() && MeshletBuilder::IsBackfacing(meshlet, cameraPosition))
+        {
+            stats.backfaceCulledClusters++;
+            continue;
+        }
+
+        stats.triangles += meshlet.indexCount / 3;
+        list.Add(meshlet.indexCount, indexByteOffset + meshlet.indexOffset * indexSize, indexSize, (GLint)(firstVertex + meshlet.baseVertex));
+    }
+    stats.clusters += lod.meshletCount;
+}
+
+void Mesh::SubmitRuns(const GLsizei* counts, const void* const* offsets, const GLint* baseVertices, size_t runCount)
+{
+    if (runCount == 0)
+        return;
+
+    GLCall(glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts, indexType, offsets, (GLsizei)runCount, baseVertices));
+    Renderer::GetStats().drawCalls++;
+}
+
+void Mesh::DrawInstanced(Shader& shader, const ObjectData* instances, const uint8_t* lods, size_t count)
+{
+    if (count == 0)
+        return;
+
+    BindMaterial(shader);
+    shader.setBool(SHADER_NAME("instanced"), true);
+    GLCall(glBindVertexArray(VAO));
+    SubmitInstances(instances, lods, count);
+    GLCall(glBindVertexArray(0));
+    shader.setBool(SHADER_NAME("instanced"), false);
+}
+
+void Mesh::SubmitInstances(const ObjectData* instances, const uint8_t* lods, size_t count)
+{
+    if (count == 0)
+        return;
+
+    // Counting sort by level, so each level reads one contiguous slice of the buffer
+    instanceLodStarts.assign(lodLevels.size() + 1, 0);
+    for (size_t i = 0; i < count; i++)
+        instanceLodStarts[lods[i] + 1]++;
+    for (size_t i = 1; i < instanceLodStarts.size(); i++)
+        instanceLodStarts[i] += instanceLodStarts[i - 1];
+    instanceTransforms.resize(count);
+    instanceLodCursor.assign(instanceLodStarts.begin(), instanceLodStarts.end() - 1);
+    for (size_t i = 0; i < count; i++)
+        instanceTransforms[instanceLodCursor[lods[i]]++] = instances[i];
+
+    RenderStats& stats = Renderer::GetStats();
+    size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+    GLCall(glBindBuffer(GL_ARRAY_BUFFER, instanceVBO));
+    GLCall(glBufferData(GL_ARRAY_BUFFER, count * sizeof(ObjectData), instanceTransforms.data(), GL_STREAM_DRAW));
+    for (size_t level = 0; level < lodLevels.size(); level++)
+    {
+        size_t instances = instanceLodStarts[level + 1] - instanceLodStarts[level];
+        if (instances == 0)
+            continue;
+
+        VertexFormat::SetupInstanceAttributes(instanceLodStarts[level] * sizeof(ObjectData));
+        const DrawLod& lod = lodLevels[level];
+        for (size_t i = lod.firstRange; i < lod.firstRange + lod.rangeCount; i++)
+        {
+            const DrawRange& range = ranges[i];
+            GLCall(glDrawElementsInstancedBaseVertex(GL_TRIANGLES, (GLsizei)range.indexCount, indexType, (void*)(indexByteOffset + range.indexOffset * indexSize),
+                (GLsizei)instances, (GLint)(firstVertex + range.baseVertex)));
+            stats.drawCalls++;
+            stats.triangles += range.indexCount / 3 * instances;
+        }
+    }
+
+    // Later non-instanced draws fetch the first matrix
+    VertexFormat::SetupInstanceAttributes(0);
+}
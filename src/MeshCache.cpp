@@ -0,0 +1,433 @@
+#include "MeshCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	const char kMagic[4] = { 'M', 'V', 'M', 'C' };
+	const uint32_t kVersion = 7;
+	const uint64_t kAlignment = 16;
+
+	struct FileHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t vertexSize;
+		uint32_t importFlags;
+		uint64_t sourceSize;
+		int64_t sourceMtime;
+		uint32_t nodeCount;
+		uint32_t meshCount;
+		uint32_t pathLength;
+	};
+
+	struct NodeRecord
+	{
+		int32_t parent;
+		float local[16];
+	};
+
+	struct MeshRecord
+	{
+		uint64_t vertexOffset;
+		uint64_t vertexCount;
+		uint64_t indexOffset;
+		uint64_t indexCount;
+		uint32_t textureCount;
+		uint32_t lodCount;
+		uint32_t instanceCount;
+		uint32_t attributes;
+	};
+
+	struct LodRecord
+	{
+		uint64_t indexOffset;
+		uint64_t indexCount;
+		float error;
+		uint32_t reserved;
+	};
+
+	uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	// Entries record this form of the source path, and are keyed by it
+	std::string CanonicalPath(const std::string& path)
+	{
+		std::error_code error;
+		std::string canonical = fs::weakly_canonical(path, error).string();
+		return error ? path : canonical;
+	}
+
+	// count elements of elementSize starting at offset lie within size bytes; cannot overflow
+	bool FitsArray(size_t size, uint64_t offset, uint64_t count, size_t elementSize)
+	{
+		return offset <= size && count <= (size - offset) / elementSize;
+	}
+
+	uint64_t AlignUp(uint64_t value)
+	{
+		return (value + kAlignment - 1) & ~(kAlignment - 1);
+	}
+
+	void WriteString(std::ofstream& out, const std::string& value)
+	{
+		uint32_t length = static_cast<uint32_t>(value.size());
+		out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+		out.write(value.data(), length);
+	}
+
+	bool ReadString(const unsigned char* data, size_t size, size_t& cursor, std::string& value)
+	{
+		uint32_t length;
+		if (cursor + sizeof(length) > size)
+			return false;
+		std::memcpy(&length, data + cursor, sizeof(length));
+		cursor += sizeof(length);
+		if (cursor + length > size)
+			return false;
+		value.assign(reinterpret_cast<const char*>(data + cursor), length);
+		cursor += length;
+		return true;
+	}
+
+	void Pad(std::ofstream& out)
+	{
+		static const char zeros[kAlignment] = {};
+		uint64_t position = static_cast<uint64_t>(out.tellp());
+		out.write(zeros, AlignUp(position) - position);
+	}
+}
+
+std::string MeshCache::s_Directory = "cache/meshes";
+uint64_t MeshCache::s_BudgetBytes = 1ull << 30;
+
+void MeshCache::SetDirectory(const std::string& directory)
+{
+	s_Directory = directory;
+}
+
+void MeshCache::SetBudget(uint64_t budgetBytes)
+{
+	s_BudgetBytes = budgetBytes;
+}
+
+bool MeshCache::GetSourceKey(const std::string& sourcePath, uint64_t& size, int64_t& mtime)
+{
+	std::error_code error;
+	size = fs::file_size(sourcePath, error);
+	if (error)
+		return false;
+	mtime = static_cast<int64_t>(fs::last_write_time(sourcePath, error).time_since_epoch().count());
+	return !error;
+}
+
+std::string MeshCache::GetEntryPath(const std::string& sourcePath, uint64_t size, int64_t mtime, unsigned int importFlags)
+{
+	std::string canonical = CanonicalPath(sourcePath);
+	uint64_t hash = 14695981039346656037ull;
+	hash = HashBytes(hash, canonical.data(), canonical.size());
+	hash = HashBytes(hash, &size, sizeof(size));
+	hash = HashBytes(hash, &mtime, sizeof(mtime));
+	hash = HashBytes(hash, &importFlags, sizeof(importFlags));
+	hash = HashBytes(hash, &kVersion, sizeof(kVersion));
+
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.mvmc", static_cast<unsigned long long>(hash));
+	return (fs::path(s_Directory) / name).string();
+}
+
+std::unique_ptr<MeshCache::Entry> MeshCache::Load(const std::string& sourcePath, unsigned int importFlags)
+{
+	uint64_t sourceSize;
+	int64_t sourceMtime;
+	if (!GetSourceKey(sourcePath, sourceSize, sourceMtime))
+		return nullptr;
+
+	std::string entryPath = GetEntryPath(sourcePath, sourceSize, sourceMtime, importFlags);
+	std::unique_ptr<Entry> entry = std::make_unique<Entry>();
+	if (!entry->file.Open(entryPath))
+		return nullptr;
+
+	const unsigned char* data = entry->file.GetData();
+	size_t size = entry->file.GetSize();
+
+	FileHeader header;
+	if (size < sizeof(header))
+		return nullptr;
+	std::memcpy(&header, data, sizeof(header));
+	if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion
+		|| header.vertexSize != sizeof(Vertex) || header.importFlags != importFlags
+		|| header.sourceSize != sourceSize || header.sourceMtime != sourceMtime)
+	{
+		std::cout << "Mesh cache entry " << entryPath << " is stale, ignoring" << std::endl;
+		return nullptr;
+	}
+
+	// The key is a hash, so the entry must name this source too
+	std::string storedPath;
+	size_t cursor = sizeof(header);
+	if (!FitsArray(size, cursor, header.pathLength, 1))
+		return nullptr;
+	storedPath.assign(reinterpret_cast<const char*>(data + cursor), header.pathLength);
+	cursor += header.pathLength;
+	if (storedPath != CanonicalPath(sourcePath))
+	{
+		std::cout << "Mesh cache entry " << entryPath << " belongs to " << storedPath << ", ignoring" << std::endl;
+		return nullptr;
+	}
+
+	for (uint32_t i = 0; i < header.nodeCount; i++)
+	{
+		NodeRecord record;
+		std::string name;
+		if (cursor + sizeof(record) > size)
+			return nullptr;
+		std::memcpy(&record, data + cursor, sizeof(record));
+		cursor += sizeof(record);
+		if (!ReadString(data, size, cursor, name) || record.parent < SceneGraph::kNoParent || record.parent >= static_cast<int32_t>(i))
+			return nullptr;
+
+		glm::mat4 local;
+		std::memcpy(&local[0][0], record.local, sizeof(record.local));
+		entry->scene.AddNode(record.parent, local, name);
+	}
+
+	// Counts are checked against the bytes left before anything is sized by them
+	if (!FitsArray(size, cursor, header.meshCount, sizeof(MeshRecord)))
+		return nullptr;
+	entry->meshes.resize(header.meshCount);
+	for (CachedMesh& mesh : entry->meshes)
+	{
+		MeshRecord record;
+		if (cursor + sizeof(record) > size)
+			return nullptr;
+		std::memcpy(&record, data + cursor, sizeof(record));
+		cursor += sizeof(record);
+
+		if (!FitsArray(size, record.vertexOffset, record.vertexCount, sizeof(Vertex))
+			|| !FitsArray(size, record.indexOffset, record.indexCount, sizeof(unsigned int))
+			|| !FitsArray(size, cursor, record.textureCount, 2 * sizeof(uint32_t))
+			|| !FitsArray(size, cursor, record.lodCount, sizeof(LodRecord))
+			|| !FitsArray(size, cursor, record.instanceCount, sizeof(int32_t)))
+			return nullptr;
+
+		mesh.vertices = reinterpret_cast<const Vertex*>(data + record.vertexOffset);
+		mesh.vertexCount = static_cast<size_t>(record.vertexCount);
+		mesh.indices = reinterpret_cast<const unsigned int*>(data + record.indexOffset);
+		mesh.indexCount = static_cast<size_t>(record.indexCount);
+		mesh.attributes = record.attributes;
+
+		mesh.textures.resize(record.textureCount);
+		for (TextureRef& texture : mesh.textures)
+		{
+			if (!ReadString(data, size, cursor, texture.type) || !ReadString(data, size, cursor, texture.path))
+				return nullptr;
+		}
+
+		mesh.lods.resize(record.lodCount);
+		for (MeshLod& lod : mesh.lods)
+		{
+			LodRecord lodRecord;
+			if (cursor + sizeof(lodRecord) > size)
+				return nullptr;
+			std::memcpy(&lodRecord, data + cursor, sizeof(lodRecord));
+			cursor += sizeof(lodRecord);
+			if (lodRecord.indexOffset > record.indexCount || lodRecord.indexCount > record.indexCount - lodRecord.indexOffset)
+				return nullptr;
+			lod = { static_cast<size_t>(lodRecord.indexOffset), static_cast<size_t>(lodRecord.indexCount), lodRecord.error };
+		}
+
+		mesh.nodes.resize(record.instanceCount);
+		for (int& node : mesh.nodes)
+		{
+			int32_t nodeIndex;
+			if (cursor + sizeof(nodeIndex) > size)
+				return nullptr;
+			std::memcpy(&nodeIndex, data + cursor, sizeof(nodeIndex));
+			cursor += sizeof(nodeIndex);
+			if (nodeIndex < 0 || nodeIndex >= static_cast<int32_t>(header.nodeCount))
+				return nullptr;
+			node = nodeIndex;
+		}
+	}
+
+	// Touch the entry so eviction sees it as recently used
+	std::error_code error;
+	fs::last_write_time(entryPath, fs::file_time_type::clock::now(), error);
+	return entry;
+}
+
+bool MeshCache::Store(const std::string& sourcePath, unsigned int importFlags, const std::vector<Mesh>& meshes,
+	const SceneGraph& scene, const std::vector<std::vector<int>>& meshNodes)
+{
+	uint64_t sourceSize;
+	int64_t sourceMtime;
+	if (!GetSourceKey(sourcePath, sourceSize, sourceMtime))
+		return false;
+
+	std::error_code error;
+	fs::create_directories(s_Directory, error);
+
+	std::string entryPath = GetEntryPath(sourcePath, sourceSize, sourceMtime, importFlags);
+	std::string tempPath = entryPath + ".tmp";
+
+	// Layout: header, source path, node records + names, mesh records + texture,
+	// LOD and instance node tables, aligned blobs
+	uint64_t tableSize = 0;
+	for (size_t i = 0; i < scene.GetNodeCount(); i++)
+		tableSize += sizeof(NodeRecord) + sizeof(uint32_t) + scene.GetName(static_cast<int>(i)).size();
+	for (const Mesh& mesh : meshes)
+	{
+		tableSize += sizeof(MeshRecord);
+		for (const Texture& texture : mesh.textures)
+			tableSize += 2 * sizeof(uint32_t) + texture.type.size() + texture.path.size();
+		tableSize += mesh.lods.size() * sizeof(LodRecord);
+	}
+	for (const std::vector<int>& nodes : meshNodes)
+		tableSize += nodes.size() * sizeof(int32_t);
+
+	std::string storedPath = CanonicalPath(sourcePath);
+	uint64_t blobOffset = AlignUp(sizeof(FileHeader) + storedPath.size() + tableSize);
+	std::vector<MeshRecord> records(meshes.size());
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		records[i].vertexOffset = blobOffset;
+		records[i].vertexCount = meshes[i].vertices.size();
+		blobOffset = AlignUp(blobOffset + meshes[i].vertices.size() * sizeof(Vertex));
+		records[i].indexOffset = blobOffset;
+		records[i].indexCount = meshes[i].indices.size();
+		blobOffset = AlignUp(blobOffset + meshes[i].indices.size() * sizeof(unsigned int));
+		records[i].textureCount = static_cast<uint32_t>(meshes[i].textures.size());
+		records[i].lodCount = static_cast<uint32_t>(meshes[i].lods.size());
+		records[i].instanceCount = static_cast<uint32_t>(meshNodes[i].size());
+		records[i].attributes = meshes[i].GetVertexAttributes();
+	}
+
+	{
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		if (!out)
+		{
+			std::cout << "Failed to write mesh cache entry: " << tempPath << std::endl;
+			return false;
+		}
+
+		FileHeader header;
+		std::memcpy(header.magic, kMagic, sizeof(kMagic));
+		header.version = kVersion;
+		header.vertexSize = sizeof(Vertex);
+		header.importFlags = importFlags;
+		header.sourceSize = sourceSize;
+		header.sourceMtime = sourceMtime;
+		header.nodeCount = static_cast<uint32_t>(scene.GetNodeCount());
+		header.meshCount = static_cast<uint32_t>(meshes.size());
+		header.pathLength = static_cast<uint32_t>(storedPath.size());
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(storedPath.data(), storedPath.size());
+
+		for (size_t i = 0; i < scene.GetNodeCount(); i++)
+		{
+			NodeRecord record;
+			record.parent = scene.GetParent(static_cast<int>(i));
+			std::memcpy(record.local, &scene.GetLocal(static_cast<int>(i))[0][0], sizeof(record.local));
+			out.write(reinterpret_cast<const char*>(&record), sizeof(record));
+			WriteString(out, scene.GetName(static_cast<int>(i)));
+		}
+
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			out.write(reinterpret_cast<const char*>(&records[i]), sizeof(MeshRecord));
+			for (const Texture& texture : meshes[i].textures)
+			{
+				WriteString(out, texture.type);
+				WriteString(out, texture.path);
+			}
+			for (const MeshLod& lod : meshes[i].lods)
+			{
+				LodRecord lodRecord = { lod.indexOffset, lod.indexCount, lod.error, 0 };
+				out.write(reinterpret_cast<const char*>(&lodRecord), sizeof(lodRecord));
+			}
+			for (int node : meshNodes[i])
+			{
+				int32_t nodeIndex = node;
+				out.write(reinterpret_cast<const char*>(&nodeIndex), sizeof(nodeIndex));
+			}
+		}
+
+		for (const Mesh& mesh : meshes)
+		{
+			Pad(out);
+			out.write(reinterpret_cast<const char*>(mesh.vertices.data()), mesh.vertices.size() * sizeof(Vertex));
+			Pad(out);
+			out.write(reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size() * sizeof(unsigned int));
+		}
+		Pad(out);
+
+		if (!out)
+		{
+			std::cout << "Failed to write mesh cache entry: " << tempPath << std::endl;
+			return false;
+		}
+	}
+
+	fs::rename(tempPath, entryPath, error);
+	if (error)
+	{
+		fs::remove(tempPath, error);
+		return false;
+	}
+
+	Evict(s_BudgetBytes);
+	return true;
+}
+
+void MeshCache::Evict(uint64_t budgetBytes)
+{
+	struct CacheFile
+	{
+		fs::path path;
+		uint64_t size;
+		fs::file_time_type lastUsed;
+	};
+
+	std::error_code error;
+	std::vector<CacheFile> files;
+	uint64_t totalSize = 0;
+	for (const auto& item : fs::directory_iterator(s_Directory, error))
+	{
+		if (!item.is_regular_file(error) || item.path().extension() != ".mvmc")
+			continue;
+		CacheFile file = { item.path(), item.file_size(error), item.last_write_time(error) };
+		totalSize += file.size;
+		files.push_back(file);
+	}
+
+	if (totalSize <= budgetBytes)
+		return;
+
+	std::sort(files.begin(), files.end(), [](const CacheFile& a, const CacheFile& b) { return a.lastUsed < b.lastUsed; });
+	for (const CacheFile& file : files)
+	{
+		if (totalSize <= budgetBytes)
+			break;
+		if (fs::remove(file.path, error))
+		{
+			totalSize -= file.size;
+			std::cout << "Evicted mesh cache entry " << file.path.string() << std::endl;
+		}
+	}
+}
@@ -0,0 +1,264 @@
+#include "MeshOptimizer.h"
+#include "Mesh.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace
+{
+	// Triangles around each vertex, in compressed row form
+	struct Adjacency
+	{
+		std::vector<unsigned int> offsets;
+		std::vector<unsigned int> triangles;
+		std::vector<unsigned int> liveCount;
+
+		Adjacency(const std::vector<unsigned int>& indices, size_t vertexCount)
+			: offsets(vertexCount + 1, 0), triangles(indices.size()), liveCount(vertexCount, 0)
+		{
+			for (unsigned int index : indices)
+				liveCount[index]++;
+			for (size_t v = 0; v < vertexCount; v++)
+				offsets[v + 1] = offsets[v] + liveCount[v];
+
+			std::vector<unsigned int> cursor(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < indices.size(); i++)
+				triangles[cursor[indices[i]]++] = static_cast<unsigned int>(i / 3);
+		}
+	};
+
+	// Misses of a FIFO cache over triangles [begin, end), starting cold
+	size_t CountMisses(const unsigned int* indices, size_t begin, size_t end, std::vector<unsigned int>& cacheTime, unsigned int& clock, unsigned int cacheSize)
+	{
+		size_t misses = 0;
+		for (size_t i = begin * 3; i < end * 3; i++)
+		{
+			unsigned int v = indices[i];
+			if (clock - cacheTime[v] > cacheSize)
+			{
+				cacheTime[v] = clock++;
+				misses++;
+			}
+		}
+		return misses;
+	}
+}
+
+void MeshOptimizer::Optimize(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+	if (indices.size() < 3 || vertices.empty())
+		return;
+
+	std::vector<size_t> boundaries = OptimizeVertexCache(indices, vertices.size());
+	OptimizeOverdraw(indices, vertices, boundaries);
+	OptimizeVertexFetch(vertices, indices);
+}
+
+std::vector<size_t> MeshOptimizer::OptimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize)
+{
+	size_t triangleCount = indices.size() / 3;
+	std::vector<size_t> boundaries;
+	if (triangleCount == 0)
+		return boundaries;
+
+	Adjacency adjacency(indices, vertexCount);
+	std::vector<unsigned int>& live = adjacency.liveCount;
+	std::vector<unsigned int> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<unsigned int> deadEnds;
+	std::vector<unsigned int> candidates;
+	std::vector<unsigned int> output;
+	output.reserve(indices.size());
+
+	unsigned int timestamp = cacheSize + 1;
+	size_t cursor = 0;
+	long long fanning = indices[0];
+	boundaries.push_back(0);
+
+	while (fanning >= 0)
+	{
+		// Emit every remaining triangle around the fanning vertex
+		candidates.clear();
+		for (unsigned int a = adjacency.offsets[fanning]; a < adjacency.offsets[fanning + 1]; a++)
+		{
+			unsigned int triangle = adjacency.triangles[a];
+			if (emitted[triangle])
+				continue;
+
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int v = indices[triangle * 3 + k];
+				output.push_back(v);
+				deadEnds.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (timestamp - cacheTime[v] > cacheSize)
+					cacheTime[v] = timestamp++;
+			}
+			emitted[triangle] = true;
+		}
+
+		// Prefer the candidate that will still be cached once its fan is emitted
+		long long next = -1;
+		int bestPriority = -1;
+		for (unsigned int v : candidates)
+		{
+			if (live[v] == 0)
+				continue;
+			int priority = 0;
+			if (timestamp - cacheTime[v] + 2 * live[v] <= cacheSize)
+				priority = static_cast<int>(timestamp - cacheTime[v]);
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				next = v;
+			}
+		}
+
+		if (next < 0)
+		{
+			// Dead end: back up through recently used vertices, then scan forward
+			while (!deadEnds.empty() && next < 0)
+			{
+				unsigned int v = deadEnds.back();
+				deadEnds.pop_back();
+				if (live[v] > 0)
+					next = v;
+			}
+			while (next < 0 && cursor < indices.size())
+			{
+				unsigned int v = indices[cursor++];
+				if (live[v] > 0)
+					next = v;
+			}
+			if (next >= 0 && output.size() / 3 < triangleCount)
+				boundaries.push_back(output.size() / 3);
+		}
+		fanning = next;
+	}
+
+	indices.swap(output);
+	return boundaries;
+}
+
+void MeshOptimizer::OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices, const std::vector<size_t>& hardBoundaries,
+	unsigned int cacheSize, float threshold)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0 || hardBoundaries.empty())
+		return;
+
+	// Split hard clusters further wherever the cache is already doing well, so
+	// the sort has more freedom without hurting the vertex cache much
+	std::vector<size_t> clusters;
+	std::vector<unsigned int> cacheTime(vertices.size(), 0);
+	unsigned int clock = cacheSize + 1;
+	for (size_t c = 0; c < hardBoundaries.size(); c++)
+	{
+		size_t begin = hardBoundaries[c];
+		size_t end = c + 1 < hardBoundaries.size() ? hardBoundaries[c + 1] : triangleCount;
+
+		clock += cacheSize + 1;
+		float clusterACMR = (float)CountMisses(indices.data(), begin, end, cacheTime, clock, cacheSize) / (end - begin);
+
+		clock += cacheSize + 1;
+		size_t start = begin, misses = 0;
+		clusters.push_back(begin);
+		for (size_t t = begin; t < end; t++)
+		{
+			misses += CountMisses(indices.data(), t, t + 1, cacheTime, clock, cacheSize);
+			if (t + 1 < end && (float)misses / (t + 1 - start) <= threshold * clusterACMR)
+			{
+				clusters.push_back(t + 1);
+				start = t + 1;
+				misses = 0;
+				clock += cacheSize + 1;
+			}
+		}
+	}
+
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+	std::vector<float> sortKey(clusters.size());
+	std::vector<glm::vec3> centroids(clusters.size());
+	std::vector<glm::vec3> normals(clusters.size());
+	for (size_t c = 0; c < clusters.size(); c++)
+	{
+		size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+		glm::vec3 centroid(0.0f), normal(0.0f);
+		float area = 0.0f;
+		for (size_t t = clusters[c]; t < end; t++)
+		{
+			const glm::vec3& p0 = vertices[indices[t * 3 + 0]].Position;
+			const glm::vec3& p1 = vertices[indices[t * 3 + 1]].Position;
+			const glm::vec3& p2 = vertices[indices[t * 3 + 2]].Position;
+			glm::vec3 cross = glm::cross(p1 - p0, p2 - p0);
+			float triangleArea = glm::length(cross);
+			centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+			normal += cross;
+			area += triangleArea;
+		}
+		centroids[c] = area > 0.0f ? centroid / area : vertices[indices[clusters[c] * 3]].Position;
+		normals[c] = glm::length(normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f);
+		meshCentroid += centroid;
+		meshArea += area;
+	}
+	if (meshArea > 0.0f)
+		meshCentroid /= meshArea;
+
+	// Clusters facing away from the centre are the likeliest occluders from any view
+	for (size_t c = 0; c < clusters.size(); c++)
+		sortKey[c] = glm::dot(centroids[c] - meshCentroid, normals[c]);
+
+	std::vector<size_t> order(clusters.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+	std::vector<unsigned int> sorted;
+	sorted.reserve(indices.size());
+	for (size_t c : order)
+	{
+		size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+		sorted.insert(sorted.end(), indices.begin() + clusters[c] * 3, indices.begin() + end * 3);
+	}
+	indices.swap(sorted);
+}
+
+void MeshOptimizer::OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+	const unsigned int unused = ~0u;
+	std::vector<unsigned int> remap(vertices.size(), unused);
+	std::vector<Vertex> reordered;
+	reordered.reserve(vertices.size());
+
+	for (unsigned int& index : indices)
+	{
+		if (remap[index] == unused)
+		{
+			remap[index] = static_cast<unsigned int>(reordered.size());
+			reordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices.swap(reordered);
+}
+
+VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize)
+{
+	VertexCacheStats stats;
+	stats.triangles = indices.size() / 3;
+
+	std::vector<unsigned int> cacheTime(vertexCount, 0);
+	std::vector<bool> used(vertexCount, false);
+	unsigned int clock = cacheSize + 1;
+	stats.misses = CountMisses(indices.data(), 0, stats.triangles, cacheTime, clock, cacheSize);
+	for (unsigned int index : indices)
+	{
+		if (!used[index])
+		{
+			used[index] = true;
+			stats.vertices++;
+		}
+	}
+	return stats;
+}
@@ -0,0 +1,334 @@
+#include "MeshSimplifier.h"
+#include "Mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+namespace
+{
+	enum VertexKind
+	{
+		VERTEX_MANIFOLD,
+		VERTEX_BORDER,
+		VERTEX_LOCKED
+	};
+
+	// Symmetric 4x4 plane quadric plus the area it was accumulated over, so the
+	// error divides out to a mean squared distance
+	struct Quadric
+	{
+		double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+		double a11 = 0, a12 = 0, a13 = 0;
+		double a22 = 0, a23 = 0;
+		double a33 = 0;
+		double weight = 0;
+
+		void AddPlane(const glm::dvec3& n, double d, double w)
+		{
+			a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z; a03 += w * n.x * d;
+			a11 += w * n.y * n.y; a12 += w * n.y * n.z; a13 += w * n.y * d;
+			a22 += w * n.z * n.z; a23 += w * n.z * d;
+			a33 += w * d * d;
+			weight += w;
+		}
+
+		void Add(const Quadric& q)
+		{
+			a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+			a11 += q.a11; a12 += q.a12; a13 += q.a13;
+			a22 += q.a22; a23 += q.a23;
+			a33 += q.a33;
+			weight += q.weight;
+		}
+
+		double Evaluate(const glm::dvec3& p) const
+		{
+			double e = a00 * p.x * p.x + 2 * a01 * p.x * p.y + 2 * a02 * p.x * p.z + 2 * a03 * p.x
+				+ a11 * p.y * p.y + 2 * a12 * p.y * p.z + 2 * a13 * p.y
+				+ a22 * p.z * p.z + 2 * a23 * p.z
+				+ a33;
+			return weight > 0 ? std::max(0.0, e) / weight : 0.0;
+		}
+	};
+
+	struct Collapse
+	{
+		unsigned int from;
+		unsigned int to;
+		double cost;
+	};
+
+	uint64_t EdgeKey(unsigned int a, unsigned int b)
+	{
+		if (a > b)
+			std::swap(a, b);
+		return (uint64_t(a) << 32) | b;
+	}
+
+	struct PositionHash
+	{
+		size_t operator()(const glm::vec3& p) const
+		{
+			uint32_t bits[3];
+			std::memcpy(bits, &p, sizeof(bits));
+			return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+		}
+	};
+}
+
+std::vector<unsigned int> MeshSimplifier::Simplify(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+	size_t targetIndexCount, float& error)
+{
+	error = 0.0f;
+	size_t vertexCount = vertices.size();
+	size_t triangleCount = indices.size() / 3;
+
+	// Wedges sharing a position collapse as one; seams between them are locked
+	std::vector<unsigned int> canonical(vertexCount);
+	std::vector<unsigned int> wedgeCount(vertexCount, 0);
+	{
+		std::unordered_map<glm::vec3, unsigned int, PositionHash> byPosition;
+		byPosition.reserve(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++)
+			canonical[v] = byPosition.emplace(vertices[v].Position, static_cast<unsigned int>(v)).first->second;
+	}
+	std::vector<bool> referenced(vertexCount, false);
+	for (unsigned int index : indices)
+	{
+		if (!referenced[index])
+		{
+			referenced[index] = true;
+			wedgeCount[canonical[index]]++;
+		}
+	}
+
+	std::vector<unsigned int> corners(indices.size());
+	for (size_t i = 0; i < indices.size(); i++)
+		corners[i] = canonical[indices[i]];
+
+	std::vector<unsigned int> kind(vertexCount, VERTEX_MANIFOLD);
+	std::vector<Quadric> quadrics(vertexCount);
+	std::vector<bool> alive(triangleCount, true);
+	size_t liveTriangles = 0;
+
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		unsigned int* c = &corners[t * 3];
+		if (c[0] == c[1] || c[1] == c[2] || c[0] == c[2])
+		{
+			alive[t] = false;
+			continue;
+		}
+		liveTriangles++;
+
+		glm::dvec3 p0 = vertices[c[0]].Position, p1 = vertices[c[1]].Position, p2 = vertices[c[2]].Position;
+		glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+		double area = glm::length(normal);
+		if (area <= 0.0)
+			continue;
+		normal /= area;
+		for (int k = 0; k < 3; k++)
+			quadrics[c[k]].AddPlane(normal, -glm::dot(normal, p0), area * 0.5);
+	}
+
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		if (wedgeCount[v] > 1)
+			kind[v] = VERTEX_LOCKED;
+	}
+
+	std::unordered_map<uint64_t, unsigned int> edgeUse;
+	edgeUse.reserve(indices.size());
+	std::vector<unsigned int> offsets(vertexCount + 1), adjacency, cursor;
+	std::vector<Collapse> candidates;
+	std::vector<bool> touched(vertexCount);
+	std::vector<unsigned int> remap(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		remap[v] = static_cast<unsigned int>(v);
+
+	double maxCost = 0.0;
+	bool firstPass = true;
+	while (liveTriangles * 3 > targetIndexCount)
+	{
+		// Edge use counts find open borders and non-manifold edges
+		edgeUse.clear();
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			if (!alive[t])
+				continue;
+			const unsigned int* c = &corners[t * 3];
+			for (int k = 0; k < 3; k++)
+				edgeUse[EdgeKey(c[k], c[(k + 1) % 3])]++;
+		}
+
+		if (firstPass)
+		{
+			// Border quadrics keep open edges from shrinking inwards
+			for (size_t t = 0; t < triangleCount; t++)
+			{
+				if (!alive[t])
+					continue;
+				const unsigned int* c = &corners[t * 3];
+				glm::dvec3 p0 = vertices[c[0]].Position, p1 = vertices[c[1]].Position, p2 = vertices[c[2]].Position;
+				glm::dvec3 faceNormal = glm::cross(p1 - p0, p2 - p0);
+				for (int k = 0; k < 3; k++)
+				{
+					unsigned int a = c[k], b = c[(k + 1) % 3];
+					unsigned int uses = edgeUse[EdgeKey(a, b)];
+					if (uses > 2)
+					{
+						kind[a] = kind[b] = VERTEX_LOCKED;
+						continue;
+					}
+					if (uses != 1)
+						continue;
+
+					if (kind[a] == VERTEX_MANIFOLD)
+						kind[a] = VERTEX_BORDER;
+					if (kind[b] == VERTEX_MANIFOLD)
+						kind[b] = VERTEX_BORDER;
+
+					glm::dvec3 pa = vertices[a].Position, pb = vertices[b].Position;
+					glm::dvec3 edgeNormal = glm::cross(pb - pa, faceNormal);
+					double length = glm::length(edgeNormal);
+					if (length <= 0.0)
+						continue;
+					edgeNormal /= length;
+					double weight = glm::dot(pb - pa, pb - pa) * 10.0;
+					quadrics[a].AddPlane(edgeNormal, -glm::dot(edgeNormal, pa), weight);
+					quadrics[b].AddPlane(edgeNormal, -glm::dot(edgeNormal, pa), weight);
+				}
+			}
+			firstPass = false;
+		}
+
+		// Vertex to live triangle adjacency
+		std::fill(offsets.begin(), offsets.end(), 0);
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			if (alive[t])
+				for (int k = 0; k < 3; k++)
+					offsets[corners[t * 3 + k] + 1]++;
+		}
+		for (size_t v = 0; v < vertexCount; v++)
+			offsets[v + 1] += offsets[v];
+		adjacency.resize(offsets[vertexCount]);
+		cursor.assign(offsets.begin(), offsets.end() - 1);
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			if (alive[t])
+				for (int k = 0; k < 3; k++)
+					adjacency[cursor[corners[t * 3 + k]]++] = static_cast<unsigned int>(t);
+		}
+
+		// Cheapest legal collapse per vertex
+		candidates.clear();
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			if (!alive[t])
+				continue;
+			const unsigned int* c = &corners[t * 3];
+			for (int k = 0; k < 6; k++)
+			{
+				unsigned int from = c[k % 3];
+				unsigned int to = c[(k % 3 + (k < 3 ? 1 : 2)) % 3];
+				if (kind[from] == VERTEX_LOCKED || wedgeCount[to] > 1)
+					continue;
+				if (kind[from] == VERTEX_BORDER && edgeUse[EdgeKey(from, to)] != 1)
+					continue;
+
+				Quadric q = quadrics[from];
+				q.Add(quadrics[to]);
+				candidates.push_back({ from, to, q.Evaluate(glm::dvec3(vertices[to].Position)) });
+			}
+		}
+		if (candidates.empty())
+			break;
+
+		std::sort(candidates.begin(), candidates.end(), [](const Collapse& a, const Collapse& b) {
+			return a.cost < b.cost || (a.cost == b.cost && a.from < b.from);
+		});
+
+		// Collapses in one pass must not share neighbourhoods, so each flip test
+		// sees the geometry it will actually produce
+		std::fill(touched.begin(), touched.end(), false);
+		size_t toRemove = liveTriangles - targetIndexCount / 3;
+		size_t removed = 0, collapses = 0;
+		for (const Collapse& collapse : candidates)
+		{
+			if (removed >= toRemove)
+				break;
+			unsigned int from = collapse.from, to = collapse.to;
+			if (touched[from] || touched[to])
+				continue;
+
+			bool flips = false;
+			for (unsigned int a = offsets[from]; a < offsets[from + 1] && !flips; a++)
+			{
+				const unsigned int* c = &corners[adjacency[a] * 3];
+				if (c[0] == to || c[1] == to || c[2] == to)
+					continue;
+				glm::vec3 p[3], q[3];
+				for (int k = 0; k < 3; k++)
+				{
+					p[k] = vertices[c[k]].Position;
+					q[k] = c[k] == from ? vertices[to].Position : p[k];
+				}
+				glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+				flips = glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after);
+			}
+			if (flips)
+				continue;
+
+			for (unsigned int a = offsets[from]; a < offsets[from + 1]; a++)
+			{
+				unsigned int t = adjacency[a];
+				unsigned int* c = &corners[t * 3];
+				for (int k = 0; k < 3; k++)
+					touched[c[k]] = true;
+				if (!alive[t])
+					continue;
+				for (int k = 0; k < 3; k++)
+				{
+					if (c[k] == from)
+						c[k] = to;
+				}
+				if (c[0] == c[1] || c[1] == c[2] || c[0] == c[2])
+				{
+					alive[t] = false;
+					liveTriangles--;
+					removed++;
+				}
+			}
+
+			quadrics[to].Add(quadrics[from]);
+			remap[from] = to;
+			maxCost = std::max(maxCost, collapse.cost);
+			collapses++;
+		}
+		if (collapses == 0)
+			break;
+	}
+
+	// Canonical corners map back to the single wedge of each surviving position
+	std::vector<unsigned int> result;
+	result.reserve(liveTriangles * 3);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		if (!alive[t])
+			continue;
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int corner = corners[t * 3 + k];
+			unsigned int original = indices[t * 3 + k];
+			result.push_back(canonical[original] == corner ? original : corner);
+		}
+	}
+
+	error = static_cast<float>(std::sqrt(maxCost));
+	return result;
+}
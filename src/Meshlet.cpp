@@ -0,0 +1,115 @@
+#include "Meshlet.h"
+#include "Mesh.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	template <typename Index>
+	void BuildMeshlets(const Vertex* vertices, const unsigned int* order, size_t vertexCount, const Index* indices,
+		const DrawRange& range, std::vector<Meshlet>& out)
+	{
+		std::vector<unsigned int> stamp(vertexCount, 0);
+		unsigned int meshlet = 1;
+		size_t uniqueVertices = 0;
+		size_t start = range.indexOffset;
+		size_t end = range.indexOffset + range.indexCount;
+
+		auto position = [&](size_t i) -> const glm::vec3& {
+			size_t v = range.baseVertex + static_cast<size_t>(indices[i]);
+			return vertices[order ? order[v] : v].Position;
+		};
+
+		auto emit = [&](size_t first, size_t last) {
+			if (first == last)
+				return;
+
+			glm::vec3 boundsMin = position(first), boundsMax = boundsMin;
+			glm::vec3 normalSum(0.0f);
+			for (size_t i = first; i < last; i += 3)
+			{
+				const glm::vec3& p0 = position(i);
+				const glm::vec3& p1 = position(i + 1);
+				const glm::vec3& p2 = position(i + 2);
+				boundsMin = glm::min(boundsMin, glm::min(p0, glm::min(p1, p2)));
+				boundsMax = glm::max(boundsMax, glm::max(p0, glm::max(p1, p2)));
+
+				glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+				float length = glm::length(normal);
+				if (length > 0.0f)
+					normalSum += normal / length;
+			}
+
+			Meshlet result;
+			result.center = (boundsMin + boundsMax) * 0.5f;
+			result.radius = 0.0f;
+			for (size_t i = first; i < last; i++)
+				result.radius = std::max(result.radius, glm::length(position(i) - result.center));
+
+			// Cones wider than about 84 degrees almost never cull, so they are disabled
+			float axisLength = glm::length(normalSum);
+			result.coneAxis = axisLength > 0.0f ? normalSum / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+			result.coneCutoff = 1.0f;
+			if (axisLength > 0.0f)
+			{
+				float minDot = 1.0f;
+				for (size_t i = first; i < last; i += 3)
+				{
+					const glm::vec3& p0 = position(i);
+					glm::vec3 normal = glm::cross(position(i + 1) - p0, position(i + 2) - p0);
+					float length = glm::length(normal);
+					if (length > 0.0f)
+						minDot = std::min(minDot, glm::dot(normal / length, result.coneAxis));
+				}
+				if (minDot > 0.1f)
+					result.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+			}
+
+			result.indexOffset = static_cast<uint32_t>(first);
+			result.indexCount = static_cast<uint32_t>(last - first);
+			result.baseVertex = range.baseVertex;
+			out.push_back(result);
+		};
+
+		for (size_t t = start; t + 2 < end; t += 3)
+		{
+			size_t added = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				size_t v = range.baseVertex + static_cast<size_t>(indices[t + k]);
+				if (stamp[v] != meshlet && std::find(indices + t, indices + t + k, indices[t + k]) == indices + t + k)
+					added++;
+			}
+
+			size_t triangles = (t - start) / 3;
+			if (uniqueVertices + added > MeshletBuilder::kMaxVertices || triangles >= MeshletBuilder::kMaxTriangles)
+			{
+				emit(start, t);
+				start = t;
+				uniqueVertices = 0;
+				meshlet++;
+			}
+
+			for (int k = 0; k < 3; k++)
+			{
+				size_t v = range.baseVertex + static_cast<size_t>(indices[t + k]);
+				if (stamp[v] != meshlet)
+				{
+					stamp[v] = meshlet;
+					uniqueVertices++;
+				}
+			}
+		}
+		emit(start, end - (end - start) % 3);
+	}
+}
+
+void MeshletBuilder::Build(const Vertex* vertices, const unsigned int* order, size_t vertexCount, const void* indices, GLenum indexType,
+	const DrawRange& range, std::vector<Meshlet>& out)
+{
+	if (indexType == GL_UNSIGNED_SHORT)
+		BuildMeshlets(vertices, order, vertexCount, static_cast<const uint16_t*>(indices), range, out);
+	else
+		BuildMeshlets(vertices, order, vertexCount, static_cast<const uint32_t*>(indices), range, out);
+}
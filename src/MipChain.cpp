@@ -0,0 +1,402 @@
+#include "MipChain.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__)
+#define MIPCHAIN_AVX2 1
+#define MIPCHAIN_SSE2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIPCHAIN_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	const int kKaiserTaps = 8;
+	const int kLinearToSrgbSize = 4096;
+
+	struct Tables
+	{
+		float srgbToLinear[256];
+		unsigned char linearToSrgb[kLinearToSrgbSize];
+		float kaiser[kKaiserTaps];
+
+		Tables()
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				float c = i / 255.0f;
+				srgbToLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+			for (int i = 0; i < kLinearToSrgbSize; i++)
+			{
+				float l = i / float(kLinearToSrgbSize - 1);
+				float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+				linearToSrgb[i] = static_cast<unsigned char>(std::clamp(c * 255.0f + 0.5f, 0.0f, 255.0f));
+			}
+
+			// Kaiser-windowed sinc for 2:1 decimation; taps sit half a texel off the output centre
+			const double pi = 3.14159265358979323846;
+			const double beta = 4.0;
+			auto besselI0 = [](double x) {
+				double sum = 1.0, term = 1.0;
+				for (int k = 1; k < 20; k++)
+				{
+					term *= (x / (2.0 * k)) * (x / (2.0 * k));
+					sum += term;
+				}
+				return sum;
+			};
+
+			double total = 0.0;
+			double weights[kKaiserTaps];
+			for (int k = 0; k < kKaiserTaps; k++)
+			{
+				double d = k - (kKaiserTaps - 1) * 0.5;
+				double x = d * 0.5;
+				double sinc = std::sin(pi * x) / (pi * x);
+				double r = d / (kKaiserTaps * 0.5);
+				weights[k] = sinc * besselI0(beta * std::sqrt(std::max(0.0, 1.0 - r * r))) / besselI0(beta);
+				total += weights[k];
+			}
+			for (int k = 0; k < kKaiserTaps; k++)
+				kaiser[k] = static_cast<float>(weights[k] / total);
+		}
+	};
+
+	const Tables& GetTables()
+	{
+		static Tables tables;
+		return tables;
+	}
+
+	void DecodeRow(const unsigned char* in, float* out, int width, bool srgb)
+	{
+		const Tables& tables = GetTables();
+		for (int x = 0; x < width; x++, in += 4, out += 4)
+		{
+			for (int c = 0; c < 3; c++)
+				out[c] = srgb ? tables.srgbToLinear[in[c]] : in[c] * (1.0f / 255.0f);
+			out[3] = in[3] * (1.0f / 255.0f);
+		}
+	}
+
+	void EncodeRow(const float* in, unsigned char* out, int width, bool srgb, bool simd)
+	{
+		const Tables& tables = GetTables();
+		int x = 0;
+#if MIPCHAIN_SSE2
+		if (simd)
+		{
+			const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+			const __m128 byteScale = _mm_set1_ps(255.0f), tableScale = _mm_set1_ps(kLinearToSrgbSize - 1.0f);
+			alignas(16) int tableIndex[4];
+			for (; x < width; x++, in += 4, out += 4)
+			{
+				__m128 value = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in), zero), one);
+				__m128i bytes = _mm_cvtps_epi32(_mm_mul_ps(value, byteScale));
+				bytes = _mm_packus_epi16(_mm_packs_epi32(bytes, bytes), bytes);
+				int packed = _mm_cvtsi128_si32(bytes);
+				std::memcpy(out, &packed, 4);
+				if (srgb)
+				{
+					_mm_store_si128(reinterpret_cast<__m128i*>(tableIndex), _mm_cvtps_epi32(_mm_mul_ps(value, tableScale)));
+					out[0] = tables.linearToSrgb[tableIndex[0]];
+					out[1] = tables.linearToSrgb[tableIndex[1]];
+					out[2] = tables.linearToSrgb[tableIndex[2]];
+				}
+			}
+		}
+#endif
+		for (; x < width; x++, in += 4, out += 4)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				float value = std::clamp(in[c], 0.0f, 1.0f);
+				if (srgb && c < 3)
+					out[c] = tables.linearToSrgb[static_cast<int>(value * (kLinearToSrgbSize - 1) + 0.5f)];
+				else
+					out[c] = static_cast<unsigned char>(value * 255.0f + 0.5f);
+			}
+		}
+	}
+
+	// Averages 2x2 texels from two source rows; odd edges repeat the last texel
+	void BoxRow(const float* row0, const float* row1, float* out, int outWidth, int inWidth, bool simd)
+	{
+		int x = 0;
+#if MIPCHAIN_AVX2
+		if (simd)
+		{
+			const __m256 quarter = _mm256_set1_ps(0.25f);
+			for (; x + 1 < outWidth && 2 * x + 3 < inWidth; x += 2)
+			{
+				__m256 s0 = _mm256_add_ps(_mm256_loadu_ps(row0 + 8 * x), _mm256_loadu_ps(row1 + 8 * x));
+				__m256 s1 = _mm256_add_ps(_mm256_loadu_ps(row0 + 8 * x + 8), _mm256_loadu_ps(row1 + 8 * x + 8));
+				__m256 left = _mm256_permute2f128_ps(s0, s1, 0x20);
+				__m256 right = _mm256_permute2f128_ps(s0, s1, 0x31);
+				_mm256_storeu_ps(out + 4 * x, _mm256_mul_ps(_mm256_add_ps(left, right), quarter));
+			}
+		}
+#endif
+#if MIPCHAIN_SSE2
+		if (simd)
+		{
+			const __m128 quarter = _mm_set1_ps(0.25f);
+			for (; x < outWidth && 2 * x + 1 < inWidth; x++)
+			{
+				__m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + 8 * x), _mm_loadu_ps(row0 + 8 * x + 4)),
+					_mm_add_ps(_mm_loadu_ps(row1 + 8 * x), _mm_loadu_ps(row1 + 8 * x + 4)));
+				_mm_storeu_ps(out + 4 * x, _mm_mul_ps(sum, quarter));
+			}
+		}
+#endif
+		for (; x < outWidth; x++)
+		{
+			int x0 = std::min(2 * x, inWidth - 1) * 4;
+			int x1 = std::min(2 * x + 1, inWidth - 1) * 4;
+			for (int c = 0; c < 4; c++)
+				out[4 * x + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]) * 0.25f;
+		}
+	}
+
+	void KaiserRow(const float* in, float* out, int outWidth, int inWidth, bool simd)
+	{
+		const float* weights = GetTables().kaiser;
+		int x = 0;
+#if MIPCHAIN_SSE2
+		if (simd)
+		{
+			for (; x < outWidth; x++)
+			{
+				__m128 sum = _mm_setzero_ps();
+				for (int k = 0; k < kKaiserTaps; k++)
+				{
+					int source = std::clamp(2 * x - kKaiserTaps / 2 + 1 + k, 0, inWidth - 1);
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(in + 4 * source)));
+				}
+				_mm_storeu_ps(out + 4 * x, sum);
+			}
+		}
+#endif
+		for (; x < outWidth; x++)
+		{
+			float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for (int k = 0; k < kKaiserTaps; k++)
+			{
+				const float* texel = in + 4 * std::clamp(2 * x - kKaiserTaps / 2 + 1 + k, 0, inWidth - 1);
+				for (int c = 0; c < 4; c++)
+					sum[c] += weights[k] * texel[c];
+			}
+			std::memcpy(out + 4 * x, sum, sizeof(sum));
+		}
+	}
+
+	// out = sum of weights[k] * rows[k] over whole rows of floats
+	void WeightedSum(const float* const* rows, const float* weights, int taps, float* out, int count, bool simd)
+	{
+		int i = 0;
+#if MIPCHAIN_AVX2
+		if (simd)
+		{
+			for (; i + 8 <= count; i += 8)
+			{
+				__m256 sum = _mm256_setzero_ps();
+				for (int k = 0; k < taps; k++)
+					sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(rows[k] + i)));
+				_mm256_storeu_ps(out + i, sum);
+			}
+		}
+#endif
+#if MIPCHAIN_SSE2
+		if (simd)
+		{
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128 sum = _mm_setzero_ps();
+				for (int k = 0; k < taps; k++)
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(rows[k] + i)));
+				_mm_storeu_ps(out + i, sum);
+			}
+		}
+#endif
+		for (; i < count; i++)
+		{
+			float sum = 0.0f;
+			for (int k = 0; k < taps; k++)
+				sum += weights[k] * rows[k][i];
+			out[i] = sum;
+		}
+	}
+
+	void DownsampleBox(const ImageRGBA8& in, ImageRGBA8& out, bool srgb, bool simd)
+	{
+		ThreadPool::Get().ParallelFor(static_cast<size_t>(out.height), [&](size_t begin, size_t end) {
+			std::vector<float> scratch(static_cast<size_t>(in.width) * 4 * 2 + static_cast<size_t>(out.width) * 4);
+			float* row0 = scratch.data();
+			float* row1 = row0 + in.width * 4;
+			float* result = row1 + in.width * 4;
+			for (size_t y = begin; y < end; y++)
+			{
+				int y0 = std::min(static_cast<int>(2 * y), in.height - 1);
+				int y1 = std::min(static_cast<int>(2 * y + 1), in.height - 1);
+				DecodeRow(&in.pixels[static_cast<size_t>(y0) * in.width * 4], row0, in.width, srgb);
+				DecodeRow(&in.pixels[static_cast<size_t>(y1) * in.width * 4], row1, in.width, srgb);
+				BoxRow(row0, row1, result, out.width, in.width, simd);
+				EncodeRow(result, &out.pixels[y * out.width * 4], out.width, srgb, simd);
+			}
+		}, 16);
+	}
+
+	// Separable: each task filters the source rows its output band needs
+	// horizontally, then combines them vertically
+	void DownsampleKaiser(const ImageRGBA8& in, ImageRGBA8& out, bool srgb, bool simd)
+	{
+		const float* weights = GetTables().kaiser;
+		ThreadPool::Get().ParallelFor(static_cast<size_t>(out.height), [&](size_t begin, size_t end) {
+			int first = std::max(0, static_cast<int>(2 * begin) - kKaiserTaps / 2 + 1);
+			int last = std::min(in.height - 1, static_cast<int>(2 * end) + kKaiserTaps / 2);
+			size_t outStride = static_cast<size_t>(out.width) * 4;
+
+			std::vector<float> decoded(static_cast<size_t>(in.width) * 4);
+			std::vector<float> filtered(static_cast<size_t>(last - first + 1) * outStride);
+			std::vector<float> result(outStride);
+			for (int y = first; y <= last; y++)
+			{
+				DecodeRow(&in.pixels[static_cast<size_t>(y) * in.width * 4], decoded.data(), in.width, srgb);
+				KaiserRow(decoded.data(), &filtered[(y - first) * outStride], out.width, in.width, simd);
+			}
+
+			const float* rows[kKaiserTaps];
+			for (size_t y = begin; y < end; y++)
+			{
+				for (int k = 0; k < kKaiserTaps; k++)
+				{
+					int source = std::clamp(static_cast<int>(2 * y) - kKaiserTaps / 2 + 1 + k, 0, in.height - 1);
+					rows[k] = &filtered[(source - first) * outStride];
+				}
+				WeightedSum(rows, weights, kKaiserTaps, result.data(), static_cast<int>(outStride), simd);
+				EncodeRow(result.data(), &out.pixels[y * outStride], out.width, srgb, simd);
+			}
+		}, 16);
+	}
+}
+
+bool MipChain::s_SimdEnabled = true;
+
+void MipChain::SetSimdEnabled(bool enabled)
+{
+	s_SimdEnabled = enabled;
+}
+
+const char* MipChain::GetInstructionSet()
+{
+#if MIPCHAIN_AVX2
+	return s_SimdEnabled ? "AVX2" : "scalar";
+#elif MIPCHAIN_SSE2
+	return s_SimdEnabled ? "SSE2" : "scalar";
+#else
+	return "scalar";
+#endif
+}
+
+void MipChain::ExpandToRGBA(const unsigned char* pixels, size_t pixelCount, int channels, unsigned char* out)
+{
+	if (channels == 4)
+	{
+		std::memcpy(out, pixels, pixelCount * 4);
+		return;
+	}
+
+	size_t i = 0;
+	if (channels == 3 && s_SimdEnabled)
+	{
+#if MIPCHAIN_AVX2
+		// Four RGB texels per 128-bit lane, spread out by one shuffle
+		const __m256i shuffle = _mm256_setr_epi8(
+			0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+			0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		const __m256i alpha8 = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+		for (; i + 11 <= pixelCount; i += 8)
+		{
+			__m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i * 3));
+			__m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i * 3 + 12));
+			__m256i rgb = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+			__m256i rgba = _mm256_or_si256(_mm256_shuffle_epi8(rgb, shuffle), alpha8);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i * 4), rgba);
+		}
+#endif
+#if MIPCHAIN_SSE2
+		// SSE2 has no byte shuffle: shift texel n left by n bytes and mask it into place
+		const __m128i mask0 = _mm_setr_epi32(0x00FFFFFF, 0, 0, 0);
+		const __m128i mask1 = _mm_setr_epi32(0, 0x00FFFFFF, 0, 0);
+		const __m128i mask2 = _mm_setr_epi32(0, 0, 0x00FFFFFF, 0);
+		const __m128i mask3 = _mm_setr_epi32(0, 0, 0, 0x00FFFFFF);
+		const __m128i alpha4 = _mm_set1_epi32(static_cast<int>(0xFF000000));
+		for (; i + 6 <= pixelCount; i += 4)
+		{
+			__m128i rgb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i * 3));
+			__m128i rgba = _mm_or_si128(
+				_mm_or_si128(_mm_and_si128(rgb, mask0), _mm_and_si128(_mm_slli_si128(rgb, 1), mask1)),
+				_mm_or_si128(_mm_and_si128(_mm_slli_si128(rgb, 2), mask2), _mm_and_si128(_mm_slli_si128(rgb, 3), mask3)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 4), _mm_or_si128(rgba, alpha4));
+		}
+#endif
+	}
+
+	for (; i < pixelCount; i++)
+	{
+		const unsigned char* in = pixels + i * channels;
+		unsigned char* texel = out + i * 4;
+		if (channels <= 2)
+		{
+			texel[0] = texel[1] = texel[2] = in[0];
+			texel[3] = channels == 2 ? in[1] : 255;
+		}
+		else
+		{
+			texel[0] = in[0];
+			texel[1] = in[1];
+			texel[2] = in[2];
+			texel[3] = 255;
+		}
+	}
+}
+
+ImageRGBA8 MipChain::ExpandToRGBA(const unsigned char* pixels, int width, int height, int channels)
+{
+	ImageRGBA8 image;
+	image.width = width;
+	image.height = height;
+	image.pixels.resize(static_cast<size_t>(width) * height * 4);
+	ExpandToRGBA(pixels, static_cast<size_t>(width) * height, channels, image.pixels.data());
+	return image;
+}
+
+std::vector<ImageRGBA8> MipChain::Build(ImageRGBA8 base, MipFilter filter, bool srgb)
+{
+	std::vector<ImageRGBA8> levels;
+	if (base.width <= 0 || base.height <= 0)
+		return levels;
+
+	levels.push_back(std::move(base));
+	while (levels.back().width > 1 || levels.back().height > 1)
+	{
+		const ImageRGBA8& source = levels.back();
+		ImageRGBA8 level;
+		level.width = std::max(1, source.width / 2);
+		level.height = std::max(1, source.height / 2);
+		level.pixels.resize(static_cast<size_t>(level.width) * level.height * 4);
+
+		if (filter == MIP_FILTER_KAISER)
+			DownsampleKaiser(source, level, srgb, s_SimdEnabled);
+		else
+			DownsampleBox(source, level, srgb, s_SimdEnabled);
+		levels.push_back(std::move(level));
+	}
+	return levels;
+}
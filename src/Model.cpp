@@ -1,21 +1,653 @@
 #include "Model.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "ObjLoader.h"
 #include "Renderer.h"
+#include "TextureCache.h"
+#include "ThreadPool.h"
+#include "Timer.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <unordered_map>
+
+bool Model::useNativeObj = true;
+std::string Model::importProfile = "balanced";
+unsigned int Model::vertexAttributes = VERTEX_ATTRIBUTE_ALL;
+float Model::lodPixelError = 1.0f;
+bool Model::clusterCulling = true;
+bool Model::occlusionCulling = true;
+bool Model::mergeGeometry = true;
 
 Model::Model(std::string const& path, bool gamma)
+    : m_Path(path), m_State(LOAD_RUNNING), m_Cancel(false), m_Uploaded(false), m_TexturesReported(false), m_StoreInCache(false),
+      m_InstanceBoundsDirty(false), m_HasBounds(false), m_BoundsMin(0.0f), m_BoundsMax(0.0f), m_ProxyVAO(0), m_ProxyVBO(0)
+{
+    directory = path.substr(0, path.find_last_of('/'));
+    if (!ImportProfile::Resolve(importProfile, vertexAttributes, m_Profile))
+        ImportProfile::Resolve("balanced", vertexAttributes, m_Profile);
+
+    m_Loader = std::thread([this, path]() {
+        try
+        {
+            LoadModel(path);
+            m_State = LOAD_PRODUCED;
+        }
+        catch (const std::exception& e)
+        {
+            m_Error = e.what();
+            m_State = LOAD_FAILED;
+        }
+    });
+}
+
+Model::~Model()
+{
+    m_Cancel = true;
+    if (m_Loader.joinable())
+        m_Loader.join();
+    if (m_CacheStore.valid())
+        m_CacheStore.wait();
+
+    for (const Texture& texture : textures_loaded)
+        TextureCache::Get().Release(texture.id);
+
+    if (m_ProxyVAO)
+    {
+        GLCall(glDeleteVertexArrays(1, &m_ProxyVAO));
+        GLCall(glDeleteBuffers(1, &m_ProxyVBO));
+    }
+}
+
+void Model::Update(double budgetMs)
+{
+    TextureCache& textureCache = TextureCache::Get();
+    textureCache.Update();
+    if (m_Uploaded && !m_TexturesReported && textureCache.IsIdle())
+    {
+        const TextureCache::Stats& stats = textureCache.GetStats();
+        std::cout << "Textures ready after " << m_LoadTimer.ElapsedMs() << " ms (cache: " << stats.pathHits << " path hits, "
+            << stats.contentHits << " content hits, " << stats.misses << " misses, " << stats.textureCount << " textures, "
+            << stats.residentBytes / (1024.0 * 1024.0) << " MB resident)" << std::endl;
+        m_TexturesReported = true;
+    }
+
+    if (m_Uploaded || m_State == LOAD_FAILED)
+        return;
+
+    // Bounded per frame so the render loop keeps running while a big model streams in
+    Timer timer;
+    while (true)
+    {
+        PendingMesh pending;
+        {
+            std::lock_guard<std::mutex> lock(m_QueueMutex);
+            if (m_PendingScene)
+            {
+                m_Scene = std::move(*m_PendingScene);
+                m_PendingScene.reset();
+            }
+            if (m_Ready.empty())
+                break;
+            pending = std::move(m_Ready.front());
+            m_Ready.pop_front();
+        }
+
+        uint32_t meshIndex = (uint32_t)meshes.size();
+        m_MeshInstances.emplace_back();
+        for (int node : pending.nodes)
+        {
+            m_MeshInstances.back().push_back((uint32_t)m_InstanceNodes.size());
+            m_InstanceMeshes.push_back(meshIndex);
+            m_InstanceNodes.push_back(node);
+            m_InstanceLods.push_back(0);
+        }
+        m_ObjectBoundsMin.push_back(pending.packed.boundsMin);
+        m_ObjectBoundsMax.push_back(pending.packed.boundsMax);
+        m_InstanceBoundsDirty = true;
+        m_Occluders.push_back(std::move(pending.occluder));
+        std::vector<Texture> textures = LoadTextures(pending.data.textures);
+        GeometryArena* arena = mergeGeometry ? GetArena(pending.packed) : nullptr;
+        if (pending.vertices)
+            meshes.emplace_back(pending.packed, std::move(textures), arena);
+        else
+            meshes.emplace_back(std::move(pending.data.vertices), std::move(pending.data.indices), std::move(pending.data.lods),
+                std::move(textures), pending.packed, arena);
+
+        // Compact meshes dequantize with their own uniforms, so they never share a
+        // material. The shader variant is part of the material too.
+        const Mesh& mesh = meshes.back();
+        std::vector<unsigned int> material = { mesh.IsCompact() ? meshIndex + 1 : 0, mesh.GetShaderFeatures() };
+        for (const Texture& texture : mesh.textures)
+            material.push_back(texture.id);
+        m_MeshMaterials.push_back(m_Materials.emplace(material, (uint32_t)m_Materials.size()).first->second);
+        m_MeshVertexArrays.push_back(m_VertexArrays.emplace(mesh.GetVertexArray(), (uint32_t)m_VertexArrays.size()).first->second);
+
+        if (meshes.size() == 1)
+            std::cout << "First mesh visible after " << m_LoadTimer.ElapsedMs() << " ms" << std::endl;
+
+        if (timer.ElapsedMs() >= budgetMs)
+            return;
+    }
+
+    if (m_State != LOAD_PRODUCED)
+        return;
+
+    // The loader may have pushed its last mesh after the queue check above
+    {
+        std::lock_guard<std::mutex> lock(m_QueueMutex);
+        if (!m_Ready.empty())
+            return;
+    }
+
+    m_Uploaded = true;
+    if (m_Loader.joinable())
+        m_Loader.join();
+
+    size_t gpuBytes = 0;
+    for (const Mesh& mesh : meshes)
+        gpuBytes += mesh.GetGpuBytes();
+    std::cout << "Model fully loaded (" << meshes.size() << " meshes, " << m_InstanceNodes.size() << " instances, "
+        << m_Materials.size() << " materials, " << m_VertexArrays.size() << " vertex arrays, " << gpuBytes / (1024.0 * 1024.0) << " MB of "
+        << (VertexFormat::IsCompact() ? "compact" : "full") << " geometry) in " << m_LoadTimer.ElapsedMs() << " ms" << std::endl;
+
+    // Mesh CPU arrays no longer change, so the cache can be written off-thread
+    if (m_StoreInCache)
+    {
+        // The hierarchy is copied as imported, before anyone moves a node
+        std::vector<std::vector<int>> meshNodes(meshes.size());
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            for (uint32_t instance : m_MeshInstances[i])
+                meshNodes[i].push_back(m_InstanceNodes[instance]);
+        }
+        m_CacheStore = ThreadPool::Get().Submit([this, scene = m_Scene, meshNodes = std::move(meshNodes)]() {
+            if (MeshCache::Store(m_Path, m_Profile.flags, meshes, scene, meshNodes))
+                std::cout << "Stored model in mesh cache" << std::endl;
+        });
+    }
+}
+
+void Model::Draw(ShaderVariants& shaders)
+{
+    m_Scene.Update();
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        Shader& shader = shaders.Get(meshes[i].GetShaderFeatures());
+        shader.use();
+        if (m_MeshInstances[i].size() == 1)
+        {
+            Renderer::SetObjectTransform(m_Scene.GetWorld(m_InstanceNodes[m_MeshInstances[i][0]]));
+            meshes[i].SetLod(0);
+            meshes[i].Draw(shader);
+            continue;
+        }
+
+        m_DrawTransforms.clear();
+        for (uint32_t instance : m_MeshInstances[i])
+            m_DrawTransforms.push_back(ObjectData::FromModel(m_Scene.GetWorld(m_InstanceNodes[instance])));
+        m_DrawLods.assign(m_DrawTransforms.size(), 0);
+        Renderer::SetObjectTransform(glm::mat4(1.0f));
+        meshes[i].DrawInstanced(shader, m_DrawTransforms.data(), m_DrawLods.data(), m_DrawTransforms.size());
+    }
+
+    if (!m_Uploaded)
+        DrawProxy(shaders);
+}
+
+void Model::Draw(ShaderVariants& shaders, const ViewInfo& view)
+{
+    if (m_Scene.Update() > 0 || m_InstanceBoundsDirty)
+        UpdateInstanceBounds();
+
+    // Instance boxes are kept in model space, so the model-level frustum tests them directly
+    Frustum frustum = Frustum::FromMatrix(view.projection * view.view * view.model);
+    glm::vec3 cameraPosition = glm::vec3(glm::inverse(view.model) * glm::vec4(view.cameraPosition, 1.0f));
+
+    m_InstanceVisible.resize(m_InstanceBounds.GetPaddedCount());
+    FrustumCuller::Cull(frustum, m_InstanceBounds, m_InstanceVisible.data());
+
+    RenderStats& stats = Renderer::GetStats();
+    stats.meshes += m_InstanceNodes.size();
+    for (size_t i = 0; i < m_InstanceNodes.size(); i++)
+        stats.frustumCulledMeshes += m_InstanceVisible[i] ? 0 : 1;
+
+    if (occlusionCulling)
+        CullOccluded(view, cameraPosition);
+
+    Timer submitTimer;
+    m_Queue.Clear();
+    m_Batch.clear();
+    uint32_t identity = m_Queue.AddTransform(glm::mat4(1.0f));
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        // Each visible instance keeps its own level, with its own hysteresis
+        Mesh& mesh = meshes[i];
+        m_DrawTransforms.clear();
+        m_DrawLods.clear();
+        float depth = std::numeric_limits<float>::max();
+        uint32_t lastInstance = 0;
+        for (uint32_t instance : m_MeshInstances[i])
+        {
+            if (!m_InstanceVisible[instance])
+                continue;
+
+            ViewInfo instanceView = view;
+            instanceView.model = view.model * m_Scene.GetWorld(m_InstanceNodes[instance]);
+            m_InstanceLods[instance] = (uint8_t)mesh.SelectLod(instanceView, lodPixelError, m_InstanceLods[instance]);
+            m_DrawTransforms.push_back(ObjectData::FromModel(instanceView.model));
+            m_DrawLods.push_back(m_InstanceLods[instance]);
+            depth = std::min(depth, GetInstanceDepth(instance, cameraPosition));
+            lastInstance = instance;
+        }
+        if (m_DrawTransforms.empty())
+            continue;
+
+        if (m_DrawTransforms.size() == 1)
+        {
+            mesh.SetLod(m_DrawLods[0]);
+            m_Batch.push_back({ m_InstanceSpaces[lastInstance], m_MeshMaterials[i], m_MeshVertexArrays[i], lastInstance });
+            continue;
+        }
+
+        DrawPacket packet = {};
+        packet.key = RenderQueue::MakeKey(RENDER_PASS_OPAQUE, ShaderVariants::GetProgramId(mesh.GetShaderFeatures()),
+            m_MeshMaterials[i], m_MeshVertexArrays[i], depth);
+        packet.mesh = (uint32_t)i;
+        packet.transform = identity;
+        packet.first = m_Queue.AddInstances(m_DrawTransforms.data(), m_DrawLods.data(), m_DrawTransforms.size());
+        packet.instanceCount = (uint32_t)m_DrawTransforms.size();
+        m_Queue.Push(packet);
+    }
+
+    // Lone instances sharing a world transform, material and VAO become one
+    // packet, whichever nodes they hang from. Meshlet culling works in that space.
+    std::sort(m_Batch.begin(), m_Batch.end());
+    int transformSpace = -1;
+    uint32_t transform = identity;
+    for (size_t first = 0; first < m_Batch.size();)
+    {
+        size_t last = first + 1;
+        while (last < m_Batch.size() && m_Batch[last].SharesDraw(m_Batch[first]))
+            last++;
+
+        // Runs of one space share its transform entry
+        int space = m_Batch[first].space;
+        glm::mat4 world = view.model * m_Scene.GetWorld(space);
+        if (space != transformSpace)
+        {
+            transform = m_Queue.AddTransform(world);
+            transformSpace = space;
+        }
+        float depth = std::numeric_limits<float>::max();
+        m_DrawList.Clear();
+        Frustum nodeFrustum = Frustum::FromMatrix(view.projection * view.view * world);
+        glm::vec3 nodeCamera = glm::vec3(glm::inverse(world) * glm::vec4(view.cameraPosition, 1.0f));
+        for (size_t i = first; i < last; i++)
+        {
+            uint32_t instance = m_Batch[i].instance;
+            Mesh& mesh = meshes[m_InstanceMeshes[instance]];
+            if (clusterCulling)
+                mesh.Gather(m_DrawList, nodeFrustum, nodeCamera);
+            else
+                mesh.Gather(m_DrawList);
+            depth = std::min(depth, GetInstanceDepth(instance, cameraPosition));
+        }
+        if (!m_DrawList.IsEmpty())
+        {
+            uint32_t mesh = m_InstanceMeshes[m_Batch[first].instance];
+            DrawPacket packet = {};
+            packet.key = RenderQueue::MakeKey(RENDER_PASS_OPAQUE, ShaderVariants::GetProgramId(meshes[mesh].GetShaderFeatures()),
+                m_MeshMaterials[mesh], m_MeshVertexArrays[mesh], depth);
+            packet.mesh = mesh;
+            packet.transform = transform;
+            packet.first = m_Queue.AddRuns(m_DrawList);
+            packet.runCount = (uint32_t)m_DrawList.counts.size();
+            m_Queue.Push(packet);
+        }
+        first = last;
+    }
+
+    stats.unsortedStateChanges += CountStateChanges(m_Queue.GetPackets());
+    m_Queue.Sort();
+    ExecuteQueue(shaders);
+    stats.submitMs += submitTimer.ElapsedMs();
+
+    if (!m_Uploaded)
+        DrawProxy(shaders);
+}
+
+// Program, material, VAO, transform and instancing switches the packets need, in their current order
+size_t Model::CountStateChanges(const std::vector<DrawPacket>& packets) const
+{
+    size_t changes = 0;
+    bool instancedState = false;
+    const DrawPacket* previous = nullptr;
+    for (const DrawPacket& packet : packets)
+    {
+        if (!previous || RenderQueue::GetProgram(packet.key) != RenderQueue::GetProgram(previous->key))
+        {
+            changes++;
+            instancedState = false;
+        }
+        if (!previous || m_MeshMaterials[packet.mesh] != m_MeshMaterials[previous->mesh])
+            changes++;
+        if (!previous || m_MeshVertexArrays[packet.mesh] != m_MeshVertexArrays[previous->mesh])
+            changes++;
+        if (!previous || packet.transform != previous->transform)
+            changes++;
+        if (instancedState != (packet.instanceCount > 0))
+        {
+            changes++;
+            instancedState = packet.instanceCount > 0;
+        }
+        previous = &packet;
+    }
+    return changes;
+}
+
+// Draws the sorted packets, binding only the state that differs from the packet before
+void Model::ExecuteQueue(ShaderVariants& shaders)
+{
+    // Every transform the packets use goes up in one upload; packets then
+    // only move the object block's range
+    const std::vector<ObjectData>& transforms = m_Queue.GetTransforms();
+    size_t stride = UniformBuffer::Align(sizeof(ObjectData));
+    m_ObjectStaging.resize(transforms.size() * stride);
+    for (size_t i = 0; i < transforms.size(); i++)
+        std::memcpy(m_ObjectStaging.data() + i * stride, &transforms[i], sizeof(ObjectData));
+    if (!m_ObjectBuffer)
+        m_ObjectBuffer = std::make_unique<UniformBuffer>(m_ObjectStaging.size());
+    m_ObjectBuffer->SetData(m_ObjectStaging.data(), m_ObjectStaging.size());
+
+    Shader* shader = nullptr;
+    ShaderUniform<bool> instancedUniform;
+    bool instancedState = false;
+
+    RenderStats& stats = Renderer::GetStats();
+    const DrawPacket* previous = nullptr;
+    for (const DrawPacket& packet : m_Queue.GetPackets())
+    {
+        Mesh& mesh = meshes[packet.mesh];
+        bool instanced = packet.instanceCount > 0;
+        // The material includes the variant, so a new program always rebinds it
+        if (!previous || RenderQueue::GetProgram(packet.key) != RenderQueue::GetProgram(previous->key))
+        {
+            // Uniforms belong to a program; leave the old one with instancing off
+            if (instancedState)
+                shader->set(instancedUniform, false);
+            shader = &shaders.Get(mesh.GetShaderFeatures());
+            shader->use();
+            instancedUniform = shader->getUniform<bool>(SHADER_NAME("instanced"));
+            instancedState = false;
+            stats.stateChanges++;
+        }
+        if (!previous || m_MeshMaterials[packet.mesh] != m_MeshMaterials[previous->mesh])
+        {
+            mesh.BindMaterial(*shader);
+            stats.stateChanges++;
+        }
+        if (!previous || m_MeshVertexArrays[packet.mesh] != m_MeshVertexArrays[previous->mesh])
+        {
+            GLCall(glBindVertexArray(mesh.GetVertexArray()));
+            stats.stateChanges++;
+        }
+        if (!previous || packet.transform != previous->transform)
+        {
+            m_ObjectBuffer->BindRange(UNIFORM_BINDING_OBJECT, packet.transform * stride, sizeof(ObjectData));
+            stats.stateChanges++;
+        }
+        if (instancedState != instanced)
+        {
+            shader->set(instancedUniform, instanced);
+            instancedState = instanced;
+            stats.stateChanges++;
+        }
+
+        if (instanced)
+            mesh.SubmitInstances(m_Queue.GetInstanceTransforms(packet.first), m_Queue.GetInstanceLods(packet.first), packet.instanceCount);
+        else
+            mesh.SubmitRuns(m_Queue.GetRunCounts(packet.first), m_Queue.GetRunOffsets(packet.first), m_Queue.GetRunBaseVertices(packet.first), packet.runCount);
+        previous = &packet;
+    }
+
+    if (instancedState)
+        shader->set(instancedUniform, false);
+    GLCall(glBindVertexArray(0));
+}
+
+// Distance from the camera to the nearest point of an instance's bounding sphere, in model space
+float Model::GetInstanceDepth(uint32_t instance, const glm::vec3& cameraPosition) const
+{
+    const BoundsArray& bounds = m_InstanceBounds;
+    glm::vec3 boundsMin(bounds.minX[instance], bounds.minY[instance], bounds.minZ[instance]);
+    glm::vec3 boundsMax(bounds.maxX[instance], bounds.maxY[instance], bounds.maxZ[instance]);
+    return std::max(glm::length((boundsMin + boundsMax) * 0.5f - cameraPosition) - glm::length(boundsMax - boundsMin) * 0.5f, 0.0f);
+}
+
+GeometryArena* Model::GetArena(const PackedMesh& packed)
+{
+    for (const std::unique_ptr<GeometryArena>& arena : m_Arenas)
+    {
+        if (arena->IsCompact() == packed.compact && arena->GetIndexType() == packed.indexType)
+            return arena.get();
+    }
+    m_Arenas.push_back(std::make_unique<GeometryArena>(packed.compact, packed.indexType));
+    return m_Arenas.back().get();
+}
+
+// Model-space box of each instance from its mesh's box and its node's world transform
+void Model::UpdateInstanceBounds()
+{
+    m_InstanceBounds.Clear();
+    m_InstanceBounds.Reserve(m_InstanceNodes.size());
+    for (size_t i = 0; i < m_InstanceNodes.size(); i++)
+    {
+        uint32_t mesh = m_InstanceMeshes[i];
+        const glm::mat4& world = m_Scene.GetWorld(m_InstanceNodes[i]);
+        glm::vec3 center = glm::vec3(world * glm::vec4((m_ObjectBoundsMin[mesh] + m_ObjectBoundsMax[mesh]) * 0.5f, 1.0f));
+        glm::vec3 extent = (m_ObjectBoundsMax[mesh] - m_ObjectBoundsMin[mesh]) * 0.5f;
+        glm::vec3 worldExtent(0.0f);
+        for (int axis = 0; axis < 3; axis++)
+            worldExtent += glm::abs(glm::vec3(world[axis])) * extent[axis];
+        m_InstanceBounds.Add(center - worldExtent, center + worldExtent);
+    }
+    m_InstanceBoundsDirty = false;
+
+    // Instances whose nodes have equal world transforms share a space: the
+    // first such node. Their lone meshes can then go into one multi-draw.
+    std::map<std::array<float, 16>, int> spaces;
+    m_InstanceSpaces.resize(m_InstanceNodes.size());
+    for (size_t i = 0; i < m_InstanceNodes.size(); i++)
+    {
+        int node = m_InstanceNodes[i];
+        std::array<float, 16> world;
+        std::memcpy(world.data(), &m_Scene.GetWorld(node)[0][0], sizeof(world));
+        m_InstanceSpaces[i] = spaces.emplace(world, node).first->second;
+    }
+}
+
+// Rasterizes the instances covering the most screen into the occlusion buffer
+// and clears the visibility of every instance hidden behind them
+void Model::CullOccluded(const ViewInfo& view, const glm::vec3& cameraPosition)
+{
+    const size_t kMaxOccluders = 32;
+    // Bounding sphere radius over distance; 0.1 is roughly a tenth of the screen height
+    const float kMinOccluderSize = 0.1f;
+
+    Timer timer;
+    RenderStats& stats = Renderer::GetStats();
+    const BoundsArray& bounds = m_InstanceBounds;
+
+    std::vector<std::pair<float, size_t>> candidates;
+    for (size_t i = 0; i < m_InstanceNodes.size(); i++)
+    {
+        if (!m_InstanceVisible[i] || m_Occluders[m_InstanceMeshes[i]].indices.empty())
+            continue;
+
+        glm::vec3 boundsMin(bounds.minX[i], bounds.minY[i], bounds.minZ[i]);
+        glm::vec3 boundsMax(bounds.maxX[i], bounds.maxY[i], bounds.maxZ[i]);
+        float radius = glm::length(boundsMax - boundsMin) * 0.5f;
+        float distance = std::max(glm::length((boundsMin + boundsMax) * 0.5f - cameraPosition) - radius, 1e-3f);
+        float size = radius / distance;
+        if (size >= kMinOccluderSize)
+            candidates.push_back({ size, i });
+    }
+    if (candidates.empty())
+        return;
+
+    size_t occluderCount = std::min(kMaxOccluders, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + occluderCount, candidates.end(),
+        [](const std::pair<float, size_t>& a, const std::pair<float, size_t>& b) { return a.first > b.first; });
+
+    float aspect = view.projection[1][1] / view.projection[0][0];
+    m_Occlusion.Begin(view.projection * view.view * view.model, aspect);
+    for (size_t i = 0; i < occluderCount; i++)
+    {
+        size_t instance = candidates[i].second;
+        m_Occlusion.AddOccluder(m_Occluders[m_InstanceMeshes[instance]], m_Scene.GetWorld(m_InstanceNodes[instance]));
+    }
+    m_Occlusion.Rasterize();
+    stats.occluderTriangles += m_Occlusion.GetOccluderTriangles();
+
+    std::vector<uint8_t> occluded(m_InstanceNodes.size(), 0);
+    ThreadPool::Get().ParallelForIsolated(m_InstanceNodes.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            if (!m_InstanceVisible[i])
+                continue;
+            glm::vec3 boundsMin(bounds.minX[i], bounds.minY[i], bounds.minZ[i]);
+            glm::vec3 boundsMax(bounds.maxX[i], bounds.maxY[i], bounds.maxZ[i]);
+            occluded[i] = m_Occlusion.IsVisible(boundsMin, boundsMax) ? 0 : 1;
+        }
+    }, 1024);
+
+    for (size_t i = 0; i < m_InstanceNodes.size(); i++)
+    {
+        if (!occluded[i])
+            continue;
+        m_InstanceVisible[i] = 0;
+        stats.occludedMeshes++;
+        stats.occludedTriangles += meshes[m_InstanceMeshes[i]].GetTriangleCount(m_InstanceLods[i]);
+    }
+    stats.occlusionMs += timer.ElapsedMs();
+}
+
+void Model::PushMesh(PendingMesh mesh)
+{
+    if (mesh.vertices)
+        mesh.packed = VertexFormat::Pack(mesh.vertices, mesh.vertexCount, mesh.indices, mesh.indexCount,
+            mesh.data.lods.data(), mesh.data.lods.size());
+    else
+        mesh.packed = VertexFormat::Pack(mesh.data.vertices.data(), mesh.data.vertices.size(), mesh.data.indices.data(), mesh.data.indices.size(),
+            mesh.data.lods.data(), mesh.data.lods.size());
+    mesh.packed.attributes = mesh.data.attributes;
+    mesh.occluder = OcclusionCuller::BuildOccluder(mesh.vertices ? mesh.vertices : mesh.data.vertices.data(),
+        mesh.indices ? mesh.indices : mesh.data.indices.data(), mesh.data.lods);
+
+    std::lock_guard<std::mutex> lock(m_QueueMutex);
+    m_Ready.push_back(std::move(mesh));
+}
+
+void Model::SetBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    std::lock_guard<std::mutex> lock(m_QueueMutex);
+    m_BoundsMin = boundsMin;
+    m_BoundsMax = boundsMax;
+    m_HasBounds = true;
+}
+
+void Model::SetScene(SceneGraph graph)
 {
-	LoadModel(path);
+    std::lock_guard<std::mutex> lock(m_QueueMutex);
+    m_PendingScene = std::make_unique<SceneGraph>(std::move(graph));
 }
 
-void Model::Draw(Shader& shader)
+void Model::DrawProxy(ShaderVariants& shaders)
 {
-    for (unsigned int i = 0; i < meshes.size(); i++)
-        meshes[i].Draw(shader);
+    if (!m_ProxyVAO)
+    {
+        // Edges of the unit cube [0,1]^3, scaled onto the bounds at draw time
+        std::vector<Vertex> lines;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            for (int corner = 0; corner < 4; corner++)
+            {
+                glm::vec3 start(0.0f);
+                start[(axis + 1) % 3] = (float)(corner & 1);
+                start[(axis + 2) % 3] = (float)(corner >> 1);
+                glm::vec3 end = start;
+                end[axis] = 1.0f;
+                lines.push_back({ start, glm::vec3(0.0f, 1.0f, 0.0f), glm::vec2(0.0f) });
+                lines.push_back({ end, glm::vec3(0.0f, 1.0f, 0.0f), glm::vec2(0.0f) });
+            }
+        }
+
+        GLCall(glGenVertexArrays(1, &m_ProxyVAO));
+        GLCall(glGenBuffers(1, &m_ProxyVBO));
+        GLCall(glBindVertexArray(m_ProxyVAO));
+        GLCall(glBindBuffer(GL_ARRAY_BUFFER, m_ProxyVBO));
+        GLCall(glBufferData(GL_ARRAY_BUFFER, lines.size() * sizeof(Vertex), lines.data(), GL_STATIC_DRAW));
+        GLCall(glEnableVertexAttribArray(0));
+        GLCall(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0));
+        GLCall(glEnableVertexAttribArray(1));
+        GLCall(glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal)));
+        GLCall(glBindVertexArray(0));
+    }
+
+    // Until the importer reports real bounds, show a unit box at the origin
+    glm::vec3 boundsMin(-0.5f), boundsMax(0.5f);
+    {
+        std::lock_guard<std::mutex> lock(m_QueueMutex);
+        if (m_HasBounds)
+        {
+            boundsMin = m_BoundsMin;
+            boundsMax = m_BoundsMax;
+        }
+    }
+
+    glm::mat4 proxy = glm::translate(glm::mat4(1.0f), boundsMin);
+    proxy = glm::scale(proxy, glm::max(boundsMax - boundsMin, glm::vec3(1e-4f)));
+    Renderer::SetObjectTransform(proxy);
+    Shader& shader = shaders.Get(SHADER_FEATURE_NORMALS);
+    shader.use();
+    shader.setVec3(SHADER_NAME("positionOffset"), glm::vec3(0.0f));
+    shader.setVec3(SHADER_NAME("positionScale"), glm::vec3(1.0f));
+    shader.setBool(SHADER_NAME("octahedralNormals"), false);
+
+    GLCall(glBindVertexArray(m_ProxyVAO));
+    GLCall(glDrawArrays(GL_LINES, 0, 24));
+    GLCall(glBindVertexArray(0));
 }
 
+// Runs on the loader thread: produces meshes in order and never touches GL
 void Model::LoadModel(std::string const& path)
 {
+    if (LoadFromCache(path))
+        return;
+
+    // Imports cannot be interrupted, so a destroyed model stops on either side of one
+    if (m_Cancel)
+        return;
+    if (useNativeObj && LoadNativeObj(path))
+    {
+        m_StoreInCache = !m_Cancel;
+        return;
+    }
+    if (m_Cancel)
+        return;
+
+    Timer timer;
     Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+    m_Profile.Configure(importer);
+    const aiScene* scene = importer.ReadFile(path, m_Profile.flags);
+    if (m_Cancel)
+        return;
 
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
     {
@@ -35,28 +667,352 @@ void Model::LoadModel(std::string const& path)
         throw std::runtime_error("Invalid model file");
     }
 
+    std::error_code error;
+    double megabytes = std::filesystem::file_size(path, error) / (1024.0 * 1024.0);
+    double importMs = timer.ElapsedMs();
+    std::cout << "Assimp imported " << megabytes << " MB in " << importMs << " ms ("
+        << (importMs > 0.0 ? megabytes / (importMs / 1000.0) : 0.0) << " MB/s) with the " << m_Profile.name << " profile" << std::endl;
+
     std::cout << "Model has " << scene->mNumMeshes << " meshes" << std::endl;
     std::cout << "Model has " << scene->mNumMaterials << " materials" << std::endl;
 
-    directory = path.substr(0, path.find_last_of('/'));
-    ProcessNode(scene->mRootNode, scene);
+    // The material table is known now, so decoding can overlap mesh conversion
+    for (unsigned int i = 0; i < scene->mNumMaterials; i++)
+    {
+        std::vector<TextureRef> refs;
+        CollectMaterialTextures(scene->mMaterials[i], refs);
+        for (const TextureRef& ref : refs)
+            TextureCache::Get().Prefetch(directory + '/' + ref.path, TextureRoleFromType(ref.type));
+    }
+
+    // Node 0 is a synthetic root holding the centering translation
+    SceneGraph graph;
+    graph.AddNode(SceneGraph::kNoParent, glm::mat4(1.0f), "root");
+    std::vector<aiMesh*> order;
+    std::vector<int> nodes;
+    ProcessNode(scene->mRootNode, scene, 0, graph, order, nodes);
+    CenterScene(graph, order, nodes);
+    std::cout << "Model has " << graph.GetNodeCount() - 1 << " nodes" << std::endl;
+    SetScene(std::move(graph));
+
+    size_t vertexCount = 0, triangleCount = 0;
+    for (const aiMesh* mesh : order)
+    {
+        vertexCount += mesh->mNumVertices;
+        triangleCount += mesh->mNumFaces;
+    }
+    std::cout << "Profile " << m_Profile.name << ": import " << importMs << " ms, " << vertexCount << " vertices, "
+        << triangleCount << " triangles, " << order.size() << " draw calls" << std::endl;
+
+    ProcessMeshes(order, nodes, scene);
+    m_StoreInCache = !m_Cancel;
+}
+
+bool Model::LoadNativeObj(std::string const& path)
+{
+    std::string extension = std::filesystem::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    if (extension != ".obj")
+        return false;
+
+    PendingMesh pending;
+    if (!ObjLoader::Load(path, pending.data))
+        return false;
+    if (m_Cancel)
+        return true;
+
+    glm::vec3 boundsMin(std::numeric_limits<float>::max());
+    glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+    for (const Vertex& vertex : pending.data.vertices)
+    {
+        boundsMin = glm::min(boundsMin, vertex.Position);
+        boundsMax = glm::max(boundsMax, vertex.Position);
+    }
+    glm::vec3 center = pending.data.vertices.empty() ? glm::vec3(0.0f) : (boundsMin + boundsMax) * 0.5f;
+    if (!pending.data.vertices.empty())
+        SetBounds(boundsMin - center, boundsMax - center);
+
+    SceneGraph graph;
+    graph.AddNode(SceneGraph::kNoParent, glm::translate(glm::mat4(1.0f), -center), "root");
+    SetScene(std::move(graph));
+
+    OptimizeMesh(pending.data);
+    PrintCacheStats(pending.data.cacheBefore, pending.data.cacheAfter);
+    std::vector<size_t> lodTriangles;
+    AddLodTriangles(pending.data, lodTriangles);
+    PrintLodStats(lodTriangles);
+    pending.nodes.push_back(0);
+    PushMesh(std::move(pending));
+    return true;
+}
+
+bool Model::LoadFromCache(std::string const& path)
+{
+    Timer timer;
+    std::shared_ptr<MeshCache::Entry> entry = MeshCache::Load(path, m_Profile.flags);
+    if (!entry)
+        return false;
+
+    for (const MeshCache::CachedMesh& cached : entry->meshes)
+    {
+        for (const TextureRef& ref : cached.textures)
+            TextureCache::Get().Prefetch(directory + '/' + ref.path, TextureRoleFromType(ref.type));
+    }
+
+    // Bounds of the placed meshes; the cached scene is already centered
+    SceneGraph scene = entry->scene;
+    scene.Update();
+    glm::vec3 boundsMin(std::numeric_limits<float>::max());
+    glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+    for (const MeshCache::CachedMesh& cached : entry->meshes)
+    {
+        if (cached.vertexCount == 0)
+            continue;
+
+        glm::vec3 meshMin(std::numeric_limits<float>::max()), meshMax(-std::numeric_limits<float>::max());
+        for (size_t v = 0; v < cached.vertexCount; v++)
+        {
+            meshMin = glm::min(meshMin, cached.vertices[v].Position);
+            meshMax = glm::max(meshMax, cached.vertices[v].Position);
+        }
+        for (int node : cached.nodes)
+            AddPlacedBounds(scene.GetWorld(node), meshMin, meshMax, boundsMin, boundsMax);
+    }
+    if (boundsMin.x <= boundsMax.x)
+        SetBounds(boundsMin, boundsMax);
+
+    SetScene(std::move(scene));
+
+    // The mapped arrays go to glBufferData as-is; nothing is parsed or copied.
+    // Every pending mesh shares ownership of the mapping until it is uploaded.
+    for (const MeshCache::CachedMesh& cached : entry->meshes)
+    {
+        PendingMesh pending;
+        pending.vertices = cached.vertices;
+        pending.vertexCount = cached.vertexCount;
+        pending.indices = cached.indices;
+        pending.indexCount = cached.indexCount;
+        pending.data.lods = cached.lods;
+        pending.data.textures = cached.textures;
+        pending.data.attributes = cached.attributes;
+        pending.nodes = cached.nodes;
+        pending.source = entry;
+        PushMesh(std::move(pending));
+    }
+
+    std::cout << "Mapped " << entry->meshes.size() << " meshes from mesh cache in " << timer.ElapsedMs() << " ms" << std::endl;
+    return true;
 }
 
-void Model::ProcessNode(aiNode* node, const aiScene* scene)
+void Model::ProcessNode(aiNode* node, const aiScene* scene, int parent, SceneGraph& graph, std::vector<aiMesh*>& order, std::vector<int>& nodes)
 {
+    // aiMatrix4x4 is row-major, glm is column-major
+    const aiMatrix4x4& m = node->mTransformation;
+    glm::mat4 local(m.a1, m.b1, m.c1, m.d1,
+                    m.a2, m.b2, m.c2, m.d2,
+                    m.a3, m.b3, m.c3, m.d3,
+                    m.a4, m.b4, m.c4, m.d4);
+    int index = graph.AddNode(parent, local, node->mName.C_Str());
+
     for (unsigned int i = 0; i < node->mNumMeshes; i++)
     {
         aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        meshes.push_back(ProcessMesh(mesh, scene));
+        order.push_back(mesh);
+        nodes.push_back(index);
     }
 
     for (unsigned int i = 0; i < node->mNumChildren; i++)
     {
-        ProcessNode(node->mChildren[i], scene);
+        ProcessNode(node->mChildren[i], scene, index, graph, order, nodes);
+    }
+}
+
+// Grows the bounds by the corners of a mesh box placed with world
+void Model::AddPlacedBounds(const glm::mat4& world, const glm::vec3& meshMin, const glm::vec3& meshMax, glm::vec3& boundsMin, glm::vec3& boundsMax)
+{
+    for (int corner = 0; corner < 8; corner++)
+    {
+        glm::vec3 position((corner & 1) ? meshMax.x : meshMin.x, (corner & 2) ? meshMax.y : meshMin.y, (corner & 4) ? meshMax.z : meshMin.z);
+        position = glm::vec3(world * glm::vec4(position, 1.0f));
+        boundsMin = glm::min(boundsMin, position);
+        boundsMax = glm::max(boundsMax, position);
+    }
+}
+
+// Moves the root so the placed meshes are centered on the origin, and sizes the
+// proxy box to match
+void Model::CenterScene(SceneGraph& graph, const std::vector<aiMesh*>& order, const std::vector<int>& nodes)
+{
+    graph.Update();
+
+    glm::vec3 boundsMin(std::numeric_limits<float>::max());
+    glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        const aiMesh* mesh = order[i];
+        if (mesh->mNumVertices == 0)
+            continue;
+
+        glm::vec3 meshMin(std::numeric_limits<float>::max()), meshMax(-std::numeric_limits<float>::max());
+        for (unsigned int v = 0; v < mesh->mNumVertices; v++)
+        {
+            glm::vec3 position(mesh->mVertices[v].x, mesh->mVertices[v].y, mesh->mVertices[v].z);
+            meshMin = glm::min(meshMin, position);
+            meshMax = glm::max(meshMax, position);
+        }
+
+        AddPlacedBounds(graph.GetWorld(nodes[i]), meshMin, meshMax, boundsMin, boundsMax);
+    }
+    if (boundsMin.x > boundsMax.x)
+        return;
+
+    glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+    graph.SetLocal(0, glm::translate(glm::mat4(1.0f), -center));
+    graph.Update();
+    SetBounds(boundsMin - center, boundsMax - center);
+}
+
+void Model::ProcessMeshes(const std::vector<aiMesh*>& order, const std::vector<int>& nodes, const aiScene* scene)
+{
+    ThreadPool& pool = ThreadPool::Get();
+    Timer timer;
+
+    // Nodes referencing the same aiMesh, or meshes with identical contents,
+    // become instances of the first such mesh in node order
+    std::vector<const aiMesh*> distinct;
+    std::unordered_map<const aiMesh*, size_t> byMesh;
+    for (const aiMesh* mesh : order)
+    {
+        if (byMesh.emplace(mesh, distinct.size()).second)
+            distinct.push_back(mesh);
+    }
+    std::vector<uint64_t> hashes(distinct.size());
+    pool.ParallelFor(distinct.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            hashes[i] = HashMesh(distinct[i]);
+    }, 16);
+
+    std::vector<const aiMesh*> unique;
+    std::vector<std::vector<int>> instanceNodes;
+    std::unordered_map<uint64_t, std::vector<size_t>> byContent;
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        // A matching hash is only a candidate; the contents decide
+        std::vector<size_t>& candidates = byContent[hashes[byMesh[order[i]]]];
+        size_t match = unique.size();
+        for (size_t candidate : candidates)
+        {
+            if (SameMeshContents(unique[candidate], order[i]))
+            {
+                match = candidate;
+                break;
+            }
+        }
+        if (match == unique.size())
+        {
+            candidates.push_back(match);
+            unique.push_back(order[i]);
+            instanceNodes.emplace_back();
+        }
+        instanceNodes[match].push_back(nodes[i]);
+    }
+    std::cout << "Instancing: " << order.size() << " placements of " << distinct.size() << " aiMeshes share "
+        << unique.size() << " unique meshes" << std::endl;
+
+    // Conversion runs on the workers. Results are collected in node order and
+    // handed to the GL thread through the pending queue, so meshes[] ends up
+    // identical to the serial traversal.
+    std::vector<std::future<MeshData>> pending;
+    pending.reserve(unique.size());
+    for (const aiMesh* mesh : unique)
+        pending.push_back(pool.Submit([mesh, scene]() { return ProcessMesh(mesh, scene); }));
+
+    double convertMs = 0.0;
+    VertexCacheStats cacheBefore, cacheAfter;
+    std::vector<size_t> lodTriangles;
+    for (size_t i = 0; i < pending.size(); i++)
+    {
+        // Every job must still be waited on, since they read from the scene
+        PendingMesh mesh;
+        mesh.data = pending[i].get();
+        if (m_Cancel)
+            continue;
+
+        convertMs += mesh.data.convertMs;
+        cacheBefore += mesh.data.cacheBefore;
+        cacheAfter += mesh.data.cacheAfter;
+        AddLodTriangles(mesh.data, lodTriangles);
+        PrintMeshInfo(unique[i]);
+        mesh.nodes = std::move(instanceNodes[i]);
+        PushMesh(std::move(mesh));
+    }
+
+    double wallMs = timer.ElapsedMs();
+    std::cout << "Processed " << unique.size() << " meshes on " << pool.GetThreadCount() << " threads in "
+        << wallMs << " ms (conversion " << convertMs << " ms serial, speedup x"
+        << (wallMs > 0.0 ? convertMs / wallMs : 0.0) << ")" << std::endl;
+    PrintCacheStats(cacheBefore, cacheAfter);
+    PrintLodStats(lodTriangles);
+}
+
+// FNV-1a over everything ProcessMesh reads from the mesh
+uint64_t Model::HashMesh(const aiMesh* mesh)
+{
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&hash](const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+    };
+
+    unsigned int layout[4] = { mesh->mNumVertices, mesh->mNumFaces, mesh->mMaterialIndex,
+        (mesh->HasNormals() ? 1u : 0u) | (mesh->mTextureCoords[0] ? 2u : 0u) };
+    add(layout, sizeof(layout));
+    add(mesh->mVertices, mesh->mNumVertices * sizeof(aiVector3D));
+    if (mesh->HasNormals())
+        add(mesh->mNormals, mesh->mNumVertices * sizeof(aiVector3D));
+    if (mesh->mTextureCoords[0])
+        add(mesh->mTextureCoords[0], mesh->mNumVertices * sizeof(aiVector3D));
+    for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+    {
+        const aiFace& face = mesh->mFaces[i];
+        add(&face.mNumIndices, sizeof(face.mNumIndices));
+        add(face.mIndices, face.mNumIndices * sizeof(unsigned int));
+    }
+    return hash;
+}
+
+// Compares everything HashMesh covers
+bool Model::SameMeshContents(const aiMesh* a, const aiMesh* b)
+{
+    if (a == b)
+        return true;
+    if (a->mNumVertices != b->mNumVertices || a->mNumFaces != b->mNumFaces || a->mMaterialIndex != b->mMaterialIndex
+        || a->HasNormals() != b->HasNormals() || (a->mTextureCoords[0] != nullptr) != (b->mTextureCoords[0] != nullptr))
+        return false;
+
+    size_t bytes = a->mNumVertices * sizeof(aiVector3D);
+    if (std::memcmp(a->mVertices, b->mVertices, bytes) != 0)
+        return false;
+    if (a->HasNormals() && std::memcmp(a->mNormals, b->mNormals, bytes) != 0)
+        return false;
+    if (a->mTextureCoords[0] && std::memcmp(a->mTextureCoords[0], b->mTextureCoords[0], bytes) != 0)
+        return false;
+    for (unsigned int i = 0; i < a->mNumFaces; i++)
+    {
+        const aiFace& faceA = a->mFaces[i];
+        const aiFace& faceB = b->mFaces[i];
+        if (faceA.mNumIndices != faceB.mNumIndices
+            || std::memcmp(faceA.mIndices, faceB.mIndices, faceA.mNumIndices * sizeof(unsigned int)) != 0)
+            return false;
     }
+    return true;
 }
 
-Mesh Model::ProcessMesh(aiMesh* mesh, const aiScene* scene)
+void Model::PrintMeshInfo(const aiMesh* mesh)
 {
     std::cout << "=== MESH DEBUG INFO ===" << std::endl;
     std::cout << "Vertices: " << mesh->mNumVertices << std::endl;
@@ -80,11 +1036,17 @@ Mesh Model::ProcessMesh(aiMesh* mesh, const aiScene* scene)
     if (mesh->HasTextureCoords(0)) {
         std::cout << "TexCoord attribute: OK" << std::endl;
     }
+}
 
-    std::vector<Vertex> vertices;
-    std::vector<unsigned int> indices;
-    std::vector<Texture> textures;
+// Runs on a worker thread: must only read from the scene and must not touch GL
+MeshData Model::ProcessMesh(const aiMesh* mesh, const aiScene* scene)
+{
+    Timer timer;
+    MeshData data;
+    std::vector<Vertex>& vertices = data.vertices;
+    std::vector<unsigned int>& indices = data.indices;
 
+    vertices.reserve(mesh->mNumVertices);
     for (unsigned int i = 0; i < mesh->mNumVertices; i++)
     {
         Vertex vertex;
@@ -115,117 +1077,113 @@ Mesh Model::ProcessMesh(aiMesh* mesh, const aiScene* scene)
         vertices.push_back(vertex);
     }
 
-    glm::vec3 center(0.0f);
-    for (auto& v : vertices)
-        center += v.Position;
-    center /= vertices.size();
-
-    for (auto& v : vertices)
-        v.Position -= center;
-
+    indices.reserve(mesh->mNumFaces * 3);
     for (unsigned int i = 0; i < mesh->mNumFaces; i++)
     {
-        aiFace face = mesh->mFaces[i];
+        const aiFace& face = mesh->mFaces[i];
         for (unsigned int j = 0; j < face.mNumIndices; j++)
             indices.push_back(face.mIndices[j]);
     }
 
-    aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-
-    std::vector<Texture> diffuseMaps = LoadTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-    textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-
-    std::vector<Texture> specularMaps = LoadTextures(material, aiTextureType_SPECULAR, "texture_specular");
-    textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+    data.attributes = VERTEX_ATTRIBUTE_POSITION | (mesh->HasNormals() ? VERTEX_ATTRIBUTE_NORMAL : 0)
+        | (mesh->mTextureCoords[0] ? VERTEX_ATTRIBUTE_TEXCOORD : 0);
+    CollectMaterialTextures(scene->mMaterials[mesh->mMaterialIndex], data.textures);
+    OptimizeMesh(data);
 
-    std::vector<Texture> normalMaps = LoadTextures(material, aiTextureType_HEIGHT, "texture_normal");
-    textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
-
-    std::vector<Texture> heightMaps = LoadTextures(material, aiTextureType_AMBIENT, "texture_height");
-    textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+    data.convertMs = timer.ElapsedMs();
+    return data;
+}
 
-    return Mesh(vertices, indices, textures);
+// Reorders for the vertex cache, overdraw and vertex fetch before anything is
+// uploaded, then appends the simplified levels of detail
+void Model::OptimizeMesh(MeshData& data)
+{
+    data.cacheBefore = MeshOptimizer::AnalyzeVertexCache(data.indices, data.vertices.size());
+    MeshOptimizer::Optimize(data.vertices, data.indices);
+    data.cacheAfter = MeshOptimizer::AnalyzeVertexCache(data.indices, data.vertices.size());
+    BuildLods(data);
 }
 
-std::vector<Texture> Model::LoadTextures(aiMaterial* mat, aiTextureType type, std::string typeName)
+// Each level halves the triangles of the one before and indexes the same
+// vertices, so all of them live in one vertex buffer
+void Model::BuildLods(MeshData& data)
 {
-    std::vector<Texture> textures;
-    for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+    const size_t kMaxLods = 6;
+    const size_t kMinTriangles = 64;
+
+    data.lods.clear();
+    data.lods.push_back({ 0, data.indices.size(), 0.0f });
+
+    std::vector<unsigned int> previous = data.indices;
+    float error = 0.0f;
+    while (data.lods.size() < kMaxLods && previous.size() / 3 >= kMinTriangles * 2)
     {
-        aiString str;
-        mat->GetTexture(type, i, &str);
+        float levelError;
+        std::vector<unsigned int> level = MeshSimplifier::Simplify(data.vertices, previous, previous.size() / 6 * 3, levelError);
+        // Stop once seams and borders leave too little to collapse
+        if (level.empty() || level.size() > previous.size() * 9 / 10)
+            break;
 
-        bool skip = false;
-        for (unsigned int j = 0; j < textures_loaded.size(); j++)
-        {
-            if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-            {
-                textures.push_back(textures_loaded[j]);
-                skip = true;
-                break;
-            }
-        }
-        if (!skip)
-        {
-            Texture texture;
-            texture.id = LoadTextureFile(str.C_Str(), this->directory);
-            texture.type = typeName;
-            texture.path = str.C_Str();
-            textures.push_back(texture);
-            textures_loaded.push_back(texture);
-        }
+        MeshOptimizer::OptimizeVertexCache(level, data.vertices.size());
+        // Levels are simplified from each other, so their errors add up
+        error += levelError;
+        data.lods.push_back({ data.indices.size(), level.size(), error });
+        data.indices.insert(data.indices.end(), level.begin(), level.end());
+        previous = std::move(level);
     }
-    return textures;
 }
 
-unsigned int LoadTextureFile(const char* path, const std::string& directory, bool gamma)
+void Model::PrintCacheStats(const VertexCacheStats& before, const VertexCacheStats& after)
 {
-    std::string filename = std::string(path);
-    filename = directory + '/' + filename;
+    std::cout << "Vertex cache (" << MeshOptimizer::kCacheSize << " entries): ACMR " << before.GetACMR() << " -> " << after.GetACMR()
+        << ", ATVR " << before.GetATVR() << " -> " << after.GetATVR() << std::endl;
+}
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
+void Model::AddLodTriangles(const MeshData& data, std::vector<size_t>& triangles)
+{
+    if (triangles.size() < data.lods.size())
+        triangles.resize(data.lods.size(), 0);
+    for (size_t i = 0; i < data.lods.size(); i++)
+        triangles[i] += data.lods[i].indexCount / 3;
+}
 
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
+void Model::PrintLodStats(const std::vector<size_t>& triangles)
+{
+    std::cout << "LOD triangles:";
+    for (size_t i = 0; i < triangles.size(); i++)
+        std::cout << (i ? " / " : " ") << triangles[i];
+    std::cout << " (pixel error " << lodPixelError << ")" << std::endl;
+}
 
-    if (!data) {
-        std::cout << "Failed to load texture: " << filename << ". Using white texture.\n";
-        unsigned char whitePixel[] = { 255, 255, 255 };
-        glGenTextures(1, &textureID);
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, whitePixel);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        stbi_image_free(data);
-        return textureID;
-    }
+void Model::CollectMaterialTextures(const aiMaterial* material, std::vector<TextureRef>& out)
+{
+    CollectTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", out);
+    CollectTextures(material, aiTextureType_SPECULAR, "texture_specular", out);
+    CollectTextures(material, aiTextureType_HEIGHT, "texture_normal", out);
+    CollectTextures(material, aiTextureType_AMBIENT, "texture_height", out);
+}
 
-    if (data)
+void Model::CollectTextures(const aiMaterial* mat, aiTextureType type, const std::string& typeName, std::vector<TextureRef>& out)
+{
+    for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
     {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
+        aiString str;
+        mat->GetTexture(type, i, &str);
+        out.push_back({ typeName, str.C_Str() });
     }
-    else
+}
+
+std::vector<Texture> Model::LoadTextures(const std::vector<TextureRef>& refs)
+{
+    std::vector<Texture> textures;
+    for (const TextureRef& ref : refs)
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        Texture texture;
+        texture.id = TextureCache::Get().Acquire(this->directory + '/' + ref.path, TextureRoleFromType(ref.type));
+        texture.type = ref.type;
+        texture.path = ref.path;
+        textures.push_back(texture);
+        textures_loaded.push_back(texture);
     }
-
-    return textureID;
-}
\ No newline at end of file
+    return textures;
+}
@@ -0,0 +1,540 @@
+#include "ObjLoader.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "Timer.h"
+
+#include <cstdint>
+#include <cmath>
+#include <iostream>
+#include <string_view>
+#include <unordered_map>
+
+namespace
+{
+	const unsigned int kShardCount = 64;
+
+	enum CornerFlags : unsigned char
+	{
+		RELATIVE_V = 1,
+		RELATIVE_VT = 2,
+		RELATIVE_VN = 4
+	};
+
+	// Indices are zero-based; -1 means absent unless the matching RELATIVE_* bit
+	// is set, in which case the value is relative to the start of the chunk.
+	struct Corner
+	{
+		int v, vt, vn;
+		unsigned char flags;
+	};
+
+	struct CornerKey
+	{
+		int v, vt, vn;
+
+		bool operator==(const CornerKey& other) const
+		{
+			return v == other.v && vt == other.vt && vn == other.vn;
+		}
+	};
+
+	struct CornerKeyHash
+	{
+		size_t operator()(const CornerKey& key) const
+		{
+			uint64_t h = static_cast<uint32_t>(key.v) * 0x9E3779B97F4A7C15ull;
+			h ^= (static_cast<uint32_t>(key.vt) + 0x632BE59BD9B4E019ull) * 0xC2B2AE3D27D4EB4Full;
+			h ^= (static_cast<uint32_t>(key.vn) + 0x165667B19E3779F9ull) * 0x94D049BB133111EBull;
+			return static_cast<size_t>(h ^ (h >> 29));
+		}
+	};
+
+	struct Chunk
+	{
+		const char* begin;
+		const char* end;
+
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec3> normals;
+		std::vector<glm::vec2> uvs;
+		std::vector<Corner> corners; // three per triangle
+
+		size_t positionBase = 0;
+		size_t normalBase = 0;
+		size_t uvBase = 0;
+		size_t cornerBase = 0;
+
+		bool supported = true;
+		std::string error;
+	};
+
+	const double kPow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	inline bool IsDigit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	inline bool IsLineEnd(char c)
+	{
+		return c == '\n' || c == '\r' || c == '#';
+	}
+
+	inline const char* SkipSpaces(const char* p, const char* end)
+	{
+		while (p < end && (*p == ' ' || *p == '\t'))
+			++p;
+		return p;
+	}
+
+	inline const char* NextLine(const char* p, const char* end)
+	{
+		while (p < end && *p != '\n')
+			++p;
+		return p < end ? p + 1 : end;
+	}
+
+	// Decimal float parser without locale or allocation; accurate to well below float precision
+	bool ParseFloat(const char*& p, const char* end, float& out)
+	{
+		p = SkipSpaces(p, end);
+
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			negative = *p++ == '-';
+
+		uint64_t mantissa = 0;
+		int exponent = 0;
+		int digits = 0;
+		bool any = false;
+
+		for (; p < end && IsDigit(*p); ++p, any = true)
+		{
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+				digits += mantissa != 0;
+			}
+			else
+				exponent++;
+		}
+
+		if (p < end && *p == '.')
+		{
+			for (++p; p < end && IsDigit(*p); ++p, any = true)
+			{
+				if (digits < 19)
+				{
+					mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+					digits += mantissa != 0;
+					exponent--;
+				}
+			}
+		}
+
+		if (!any)
+			return false;
+
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			++p;
+			bool negativeExponent = false;
+			if (p < end && (*p == '-' || *p == '+'))
+				negativeExponent = *p++ == '-';
+
+			int value = 0;
+			if (p >= end || !IsDigit(*p))
+				return false;
+			for (; p < end && IsDigit(*p); ++p)
+				value = std::min(value * 10 + (*p - '0'), 1000);
+			exponent += negativeExponent ? -value : value;
+		}
+
+		double value = static_cast<double>(mantissa);
+		if (exponent < 0)
+			value = exponent >= -22 ? value / kPow10[-exponent] : value * std::pow(10.0, exponent);
+		else if (exponent > 0)
+			value = exponent <= 22 ? value * kPow10[exponent] : value * std::pow(10.0, exponent);
+
+		out = static_cast<float>(negative ? -value : value);
+		return true;
+	}
+
+	bool ParseInt(const char*& p, const char* end, int& out)
+	{
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			negative = *p++ == '-';
+
+		if (p >= end || !IsDigit(*p))
+			return false;
+
+		int value = 0;
+		for (; p < end && IsDigit(*p); ++p)
+			value = value * 10 + (*p - '0');
+
+		out = negative ? -value : value;
+		return true;
+	}
+
+	// OBJ indices are one-based, or negative to count back from the latest element
+	bool ResolveIndex(int index, size_t localCount, int& out, unsigned char& flags, unsigned char relativeFlag)
+	{
+		if (index > 0)
+		{
+			out = index - 1;
+			return true;
+		}
+		if (index < 0)
+		{
+			out = static_cast<int>(localCount) + index;
+			flags |= relativeFlag;
+			return true;
+		}
+		return false;
+	}
+
+	bool ParseCorner(const char*& p, const char* end, Chunk& chunk, Corner& corner)
+	{
+		int index;
+		corner = { -1, -1, -1, 0 };
+
+		if (!ParseInt(p, end, index) || !ResolveIndex(index, chunk.positions.size(), corner.v, corner.flags, RELATIVE_V))
+			return false;
+
+		if (p < end && *p == '/')
+		{
+			++p;
+			if (p < end && *p != '/')
+			{
+				if (!ParseInt(p, end, index) || !ResolveIndex(index, chunk.uvs.size(), corner.vt, corner.flags, RELATIVE_VT))
+					return false;
+			}
+			if (p < end && *p == '/')
+			{
+				++p;
+				if (!ParseInt(p, end, index) || !ResolveIndex(index, chunk.normals.size(), corner.vn, corner.flags, RELATIVE_VN))
+					return false;
+			}
+		}
+		return p >= end || *p == ' ' || *p == '\t' || IsLineEnd(*p);
+	}
+
+	void ParseChunk(Chunk& chunk)
+	{
+		const char* p = chunk.begin;
+		const char* end = chunk.end;
+
+		while (p < end && chunk.supported)
+		{
+			const char* line = SkipSpaces(p, end);
+			p = NextLine(line, end);
+			if (line >= end || IsLineEnd(*line))
+				continue;
+
+			const char* keyword = line;
+			while (line < end && *line != ' ' && *line != '\t' && !IsLineEnd(*line))
+				++line;
+			std::string_view name(keyword, static_cast<size_t>(line - keyword));
+
+			if (name == "v")
+			{
+				glm::vec3 position;
+				if (!ParseFloat(line, end, position.x) || !ParseFloat(line, end, position.y) || !ParseFloat(line, end, position.z))
+				{
+					chunk.supported = false;
+					chunk.error = "malformed vertex";
+				}
+				chunk.positions.push_back(position);
+			}
+			else if (name == "vn")
+			{
+				glm::vec3 normal;
+				if (!ParseFloat(line, end, normal.x) || !ParseFloat(line, end, normal.y) || !ParseFloat(line, end, normal.z))
+				{
+					chunk.supported = false;
+					chunk.error = "malformed normal";
+				}
+				chunk.normals.push_back(normal);
+			}
+			else if (name == "vt")
+			{
+				glm::vec2 uv(0.0f);
+				if (!ParseFloat(line, end, uv.x))
+				{
+					chunk.supported = false;
+					chunk.error = "malformed texture coordinate";
+				}
+				ParseFloat(line, end, uv.y);
+				chunk.uvs.push_back(uv);
+			}
+			else if (name == "f")
+			{
+				// Fan triangulation, as aiProcess_Triangulate does for convex polygons
+				Corner first, previous, current;
+				unsigned int count = 0;
+				while (true)
+				{
+					line = SkipSpaces(line, end);
+					if (line >= end || IsLineEnd(*line))
+						break;
+					if (!ParseCorner(line, end, chunk, current))
+					{
+						chunk.supported = false;
+						chunk.error = "malformed face";
+						break;
+					}
+					if (count == 0)
+						first = current;
+					else if (count >= 2)
+					{
+						chunk.corners.push_back(first);
+						chunk.corners.push_back(previous);
+						chunk.corners.push_back(current);
+					}
+					previous = current;
+					count++;
+				}
+			}
+			else if (name == "o" || name == "g" || name == "s")
+			{
+				// Everything is merged into one mesh; smoothing groups are ignored
+			}
+			else
+			{
+				chunk.supported = false;
+				chunk.error = "unsupported statement '" + std::string(name) + "'";
+			}
+		}
+	}
+
+	bool ResolveCorner(Corner& corner, const Chunk& chunk, size_t positionCount, size_t uvCount, size_t normalCount)
+	{
+		if (corner.flags & RELATIVE_V)
+			corner.v += static_cast<int>(chunk.positionBase);
+		if (corner.flags & RELATIVE_VT)
+			corner.vt += static_cast<int>(chunk.uvBase);
+		if (corner.flags & RELATIVE_VN)
+			corner.vn += static_cast<int>(chunk.normalBase);
+
+		return corner.v >= 0 && static_cast<size_t>(corner.v) < positionCount
+			&& corner.vt >= -1 && (corner.vt < 0 || static_cast<size_t>(corner.vt) < uvCount)
+			&& corner.vn >= -1 && (corner.vn < 0 || static_cast<size_t>(corner.vn) < normalCount);
+	}
+
+	inline unsigned int ShardOf(const Corner& corner)
+	{
+		return static_cast<unsigned int>(CornerKeyHash()({ corner.v, corner.vt, corner.vn }) >> 7) % kShardCount;
+	}
+}
+
+bool ObjLoader::Load(const std::string& path, MeshData& out)
+{
+	Timer timer;
+	MappedFile file;
+	if (!file.Open(path))
+		return false;
+
+	ThreadPool& pool = ThreadPool::Get();
+	const char* data = reinterpret_cast<const char*>(file.GetData());
+	const char* dataEnd = data + file.GetSize();
+
+	// Newline-aligned chunks of at least 1 MB, a few per worker for balance
+	size_t chunkTarget = std::max<size_t>(1u << 20, file.GetSize() / (4 * (pool.GetThreadCount() + 1)) + 1);
+	std::vector<Chunk> chunks;
+	for (const char* begin = data; begin < dataEnd;)
+	{
+		const char* end = begin + std::min<size_t>(chunkTarget, static_cast<size_t>(dataEnd - begin));
+		end = NextLine(end == dataEnd ? end : end - 1, dataEnd);
+
+		Chunk chunk;
+		chunk.begin = begin;
+		chunk.end = end;
+		chunks.push_back(std::move(chunk));
+		begin = end;
+	}
+
+	pool.ParallelFor(chunks.size(), [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			ParseChunk(chunks[i]);
+	});
+	double parseMs = timer.ElapsedMs();
+
+	size_t positionCount = 0, uvCount = 0, normalCount = 0, cornerCount = 0;
+	for (Chunk& chunk : chunks)
+	{
+		if (!chunk.supported)
+		{
+			std::cout << "OBJ fast path: " << chunk.error << ", falling back to Assimp" << std::endl;
+			return false;
+		}
+		chunk.positionBase = positionCount;
+		chunk.uvBase = uvCount;
+		chunk.normalBase = normalCount;
+		chunk.cornerBase = cornerCount;
+		positionCount += chunk.positions.size();
+		uvCount += chunk.uvs.size();
+		normalCount += chunk.normals.size();
+		cornerCount += chunk.corners.size();
+	}
+
+	if (cornerCount == 0 || cornerCount > 0xFFFFFFFFull)
+		return false;
+
+	// Flatten the per-chunk streams and make every index absolute
+	std::vector<glm::vec3> positions(positionCount);
+	std::vector<glm::vec3> normals(normalCount);
+	std::vector<glm::vec2> uvs(uvCount);
+	std::vector<Corner> corners(cornerCount);
+	std::vector<char> valid(chunks.size(), 1);
+
+	pool.ParallelFor(chunks.size(), [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			Chunk& chunk = chunks[i];
+			std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + chunk.positionBase);
+			std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + chunk.normalBase);
+			std::copy(chunk.uvs.begin(), chunk.uvs.end(), uvs.begin() + chunk.uvBase);
+			for (size_t c = 0; c < chunk.corners.size(); c++)
+			{
+				Corner corner = chunk.corners[c];
+				if (!ResolveCorner(corner, chunk, positionCount, uvCount, normalCount))
+					valid[i] = 0;
+				corners[chunk.cornerBase + c] = corner;
+			}
+		}
+	});
+
+	for (char ok : valid)
+	{
+		if (!ok)
+		{
+			std::cout << "OBJ fast path: face index out of range, falling back to Assimp" << std::endl;
+			return false;
+		}
+	}
+
+	// Weld identical v/vt/vn triples. Corners are bucketed by key hash so each
+	// shard's table is owned by a single task; walking the buckets in file order
+	// makes the first occurrence win and keeps vertex order deterministic.
+	std::vector<std::vector<std::vector<uint32_t>>> buckets(chunks.size(), std::vector<std::vector<uint32_t>>(kShardCount));
+	pool.ParallelFor(chunks.size(), [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			size_t first = chunks[i].cornerBase;
+			size_t last = first + chunks[i].corners.size();
+			for (size_t c = first; c < last; c++)
+				buckets[i][ShardOf(corners[c])].push_back(static_cast<uint32_t>(c));
+		}
+	});
+
+	std::vector<uint32_t> firstCorner(cornerCount);
+	pool.ParallelFor(kShardCount, [&](size_t begin, size_t end) {
+		for (size_t shard = begin; shard < end; shard++)
+		{
+			std::unordered_map<CornerKey, uint32_t, CornerKeyHash> table;
+			for (size_t i = 0; i < chunks.size(); i++)
+			{
+				for (uint32_t c : buckets[i][shard])
+				{
+					const Corner& corner = corners[c];
+					firstCorner[c] = table.try_emplace({ corner.v, corner.vt, corner.vn }, c).first->second;
+				}
+			}
+		}
+	});
+	buckets.clear();
+
+	// Number the unique corners in file order, then build vertices and indices
+	const size_t rangeSize = 1u << 16;
+	size_t rangeCount = (cornerCount + rangeSize - 1) / rangeSize;
+	std::vector<uint32_t> rangeBase(rangeCount + 1, 0);
+	pool.ParallelFor(rangeCount, [&](size_t begin, size_t end) {
+		for (size_t r = begin; r < end; r++)
+		{
+			size_t last = std::min(cornerCount, (r + 1) * rangeSize);
+			for (size_t c = r * rangeSize; c < last; c++)
+				rangeBase[r + 1] += firstCorner[c] == c;
+		}
+	});
+	for (size_t r = 0; r < rangeCount; r++)
+		rangeBase[r + 1] += rangeBase[r];
+
+	std::vector<Vertex>& vertices = out.vertices;
+	std::vector<unsigned int>& indices = out.indices;
+	std::vector<uint32_t> vertexOf(cornerCount);
+	vertices.resize(rangeBase[rangeCount]);
+	indices.resize(cornerCount);
+
+	pool.ParallelFor(rangeCount, [&](size_t begin, size_t end) {
+		for (size_t r = begin; r < end; r++)
+		{
+			uint32_t next = rangeBase[r];
+			size_t last = std::min(cornerCount, (r + 1) * rangeSize);
+			for (size_t c = r * rangeSize; c < last; c++)
+			{
+				if (firstCorner[c] != c)
+					continue;
+
+				const Corner& corner = corners[c];
+				Vertex& vertex = vertices[next];
+				vertex.Position = positions[corner.v];
+				vertex.Normal = corner.vn >= 0 ? normals[corner.vn] : glm::vec3(0.0f);
+				vertex.TexCoords = corner.vt >= 0 ? glm::vec2(uvs[corner.vt].x, 1.0f - uvs[corner.vt].y) : glm::vec2(0.0f);
+				vertexOf[c] = next++;
+			}
+		}
+	});
+
+	pool.ParallelFor(cornerCount, [&](size_t begin, size_t end) {
+		for (size_t c = begin; c < end; c++)
+			indices[c] = vertexOf[firstCorner[c]];
+	}, rangeSize);
+
+	// Smooth normals for corners without vn, shared per position like GenSmoothNormals
+	bool missingNormals = false;
+	for (const Corner& corner : corners)
+	{
+		if (corner.vn < 0)
+		{
+			missingNormals = true;
+			break;
+		}
+	}
+
+	if (missingNormals)
+	{
+		std::vector<glm::vec3> accumulated(positionCount, glm::vec3(0.0f));
+		for (size_t c = 0; c + 2 < cornerCount; c += 3)
+		{
+			const glm::vec3& a = positions[corners[c].v];
+			const glm::vec3& b = positions[corners[c + 1].v];
+			const glm::vec3& d = positions[corners[c + 2].v];
+			glm::vec3 faceNormal = glm::cross(b - a, d - a);
+			for (size_t k = 0; k < 3; k++)
+				accumulated[corners[c + k].v] += faceNormal;
+		}
+
+		for (size_t c = 0; c < cornerCount; c++)
+		{
+			const Corner& corner = corners[c];
+			if (corner.vn >= 0 || firstCorner[c] != c)
+				continue;
+			float length = glm::length(accumulated[corner.v]);
+			vertices[vertexOf[c]].Normal = length > 0.0f ? accumulated[corner.v] / length : glm::vec3(0.0f);
+		}
+	}
+
+	// Missing normals were generated above; missing UVs stay zero
+	out.attributes = VERTEX_ATTRIBUTE_POSITION | VERTEX_ATTRIBUTE_NORMAL | (uvCount > 0 ? VERTEX_ATTRIBUTE_TEXCOORD : 0);
+
+	double totalMs = timer.ElapsedMs();
+	double megabytes = file.GetSize() / (1024.0 * 1024.0);
+	std::cout << "OBJ fast path: " << megabytes << " MB, " << vertices.size() << " vertices, " << cornerCount / 3
+		<< " triangles in " << totalMs << " ms (parse " << parseMs << " ms, "
+		<< (totalMs > 0.0 ? megabytes / (totalMs / 1000.0) : 0.0) << " MB/s)" << std::endl;
+	return true;
+}
@@ -0,0 +1,322 @@
+#include "OcclusionCuller.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSIONCULLER_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// Triangles reaching closer than this are dropped rather than clipped
+	const float kNearW = 1e-2f;
+	const float kFarDepth = std::numeric_limits<float>::max();
+}
+
+OccluderMesh OcclusionCuller::BuildOccluder(const Vertex* vertices, const unsigned int* indices, const std::vector<MeshLod>& lods)
+{
+	OccluderMesh occluder;
+	if (lods.empty() || lods.back().indexCount / 3 > kMaxOccluderTriangles)
+		return occluder;
+
+	size_t level = 0;
+	while (lods[level].indexCount / 3 > kMaxOccluderTriangles)
+		level++;
+
+	// Keep only the vertices this level references
+	const MeshLod& lod = lods[level];
+	std::vector<uint32_t> remap;
+	occluder.indices.reserve(lod.indexCount);
+	for (size_t i = lod.indexOffset; i < lod.indexOffset + lod.indexCount; i++)
+	{
+		uint32_t index = indices[i];
+		if (index >= remap.size())
+			remap.resize(index + 1, ~0u);
+		if (remap[index] == ~0u)
+		{
+			remap[index] = static_cast<uint32_t>(occluder.positions.size());
+			occluder.positions.push_back(vertices[index].Position);
+		}
+		occluder.indices.push_back(remap[index]);
+	}
+	occluder.depthBias = lod.error;
+	return occluder;
+}
+
+void OcclusionCuller::Begin(const glm::mat4& modelViewProjection, float viewportAspect)
+{
+	m_Transform = modelViewProjection;
+
+	int height = static_cast<int>(kWidth / std::max(viewportAspect, 1e-3f));
+	height = std::min(std::max(height, kTileHeight), kWidth * 4);
+	m_Height = (height + kTileHeight - 1) / kTileHeight * kTileHeight;
+	m_TilesX = kWidth / kTileWidth;
+	m_TilesY = m_Height / kTileHeight;
+
+	m_Occluders.clear();
+	m_OccluderTransforms.clear();
+	m_Triangles.clear();
+	m_Bins.resize(static_cast<size_t>(m_TilesX) * m_TilesY);
+	for (std::vector<uint32_t>& bin : m_Bins)
+		bin.clear();
+
+	m_LevelSizes.clear();
+	int levelWidth = kWidth, levelHeight = m_Height;
+	while (true)
+	{
+		m_LevelSizes.push_back(glm::ivec2(levelWidth, levelHeight));
+		if (levelWidth == 1 && levelHeight == 1)
+			break;
+		levelWidth = std::max(1, (levelWidth + 1) / 2);
+		levelHeight = std::max(1, (levelHeight + 1) / 2);
+	}
+	m_Levels.resize(m_LevelSizes.size());
+	m_Levels[0].assign(static_cast<size_t>(kWidth) * m_Height, kFarDepth);
+}
+
+void OcclusionCuller::AddOccluder(const OccluderMesh& occluder, const glm::mat4& transform)
+{
+	if (occluder.indices.empty())
+		return;
+	m_Occluders.push_back(&occluder);
+	m_OccluderTransforms.push_back(transform);
+}
+
+void OcclusionCuller::Rasterize()
+{
+	// Setup: one slot per source triangle, so occluders can be transformed in parallel
+	std::vector<size_t> firstTriangle(m_Occluders.size() + 1, 0);
+	for (size_t i = 0; i < m_Occluders.size(); i++)
+		firstTriangle[i + 1] = firstTriangle[i] + m_Occluders[i]->GetTriangleCount();
+
+	std::vector<ScreenTriangle> triangles(firstTriangle.back());
+	ThreadPool::Get().ParallelForIsolated(m_Occluders.size(), [&](size_t begin, size_t end) {
+		std::vector<glm::vec4> clip;
+		for (size_t o = begin; o < end; o++)
+		{
+			const OccluderMesh& occluder = *m_Occluders[o];
+			glm::mat4 transform = m_Transform * m_OccluderTransforms[o];
+			clip.resize(occluder.positions.size());
+			for (size_t v = 0; v < occluder.positions.size(); v++)
+				clip[v] = transform * glm::vec4(occluder.positions[v], 1.0f);
+
+			for (size_t t = 0; t < occluder.GetTriangleCount(); t++)
+			{
+				ScreenTriangle& triangle = triangles[firstTriangle[o] + t];
+				triangle.depth = -1.0f;
+
+				const glm::vec4* corners[3];
+				float farthest = 0.0f;
+				bool nearClipped = false;
+				for (int k = 0; k < 3; k++)
+				{
+					corners[k] = &clip[occluder.indices[t * 3 + k]];
+					nearClipped |= corners[k]->w < kNearW;
+					farthest = std::max(farthest, corners[k]->w);
+				}
+				if (nearClipped)
+					continue;
+
+				float minX = kFarDepth, minY = kFarDepth, maxX = -kFarDepth, maxY = -kFarDepth;
+				for (int k = 0; k < 3; k++)
+				{
+					triangle.x[k] = (corners[k]->x / corners[k]->w * 0.5f + 0.5f) * kWidth;
+					triangle.y[k] = (corners[k]->y / corners[k]->w * 0.5f + 0.5f) * m_Height;
+					minX = std::min(minX, triangle.x[k]); maxX = std::max(maxX, triangle.x[k]);
+					minY = std::min(minY, triangle.y[k]); maxY = std::max(maxY, triangle.y[k]);
+				}
+
+				// Pixels whose centers the triangle may cover
+				triangle.minX = std::max(0, static_cast<int>(std::ceil(minX - 0.5f)));
+				triangle.minY = std::max(0, static_cast<int>(std::ceil(minY - 0.5f)));
+				triangle.maxX = std::min(kWidth - 1, static_cast<int>(std::floor(maxX - 0.5f)));
+				triangle.maxY = std::min(m_Height - 1, static_cast<int>(std::floor(maxY - 0.5f)));
+				if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+					continue;
+
+				// Both windings are drawn, as the viewer does not cull back faces
+				float area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0])
+					- (triangle.x[2] - triangle.x[0]) * (triangle.y[1] - triangle.y[0]);
+				if (area == 0.0f)
+					continue;
+				if (area < 0.0f)
+				{
+					std::swap(triangle.x[1], triangle.x[2]);
+					std::swap(triangle.y[1], triangle.y[2]);
+				}
+				triangle.depth = farthest + occluder.depthBias;
+			}
+		}
+	}, 1);
+
+	m_Triangles.clear();
+	for (const ScreenTriangle& triangle : triangles)
+	{
+		if (triangle.depth < 0.0f)
+			continue;
+
+		uint32_t index = static_cast<uint32_t>(m_Triangles.size());
+		m_Triangles.push_back(triangle);
+		for (int ty = triangle.minY / kTileHeight; ty <= triangle.maxY / kTileHeight; ty++)
+			for (int tx = triangle.minX / kTileWidth; tx <= triangle.maxX / kTileWidth; tx++)
+				m_Bins[static_cast<size_t>(ty) * m_TilesX + tx].push_back(index);
+	}
+
+	// Tiles own disjoint pixels, so they need no synchronization
+	ThreadPool::Get().ParallelForIsolated(m_Bins.size(), [this](size_t begin, size_t end) {
+		for (size_t tile = begin; tile < end; tile++)
+			RasterizeTile(static_cast<int>(tile));
+	}, 4);
+
+	BuildHierarchy();
+}
+
+void OcclusionCuller::RasterizeTile(int tile)
+{
+	int tileX = (tile % m_TilesX) * kTileWidth;
+	int tileY = (tile / m_TilesX) * kTileHeight;
+	float* depth = m_Levels[0].data();
+
+	for (uint32_t index : m_Bins[tile])
+	{
+		const ScreenTriangle& triangle = m_Triangles[index];
+		int x0 = std::max(triangle.minX, tileX) & ~3;
+		int x1 = std::min(triangle.maxX, tileX + kTileWidth - 1);
+		int y0 = std::max(triangle.minY, tileY);
+		int y1 = std::min(triangle.maxY, tileY + kTileHeight - 1);
+
+		// Edge k runs from vertex k to k + 1 and is positive on the inside. Edges
+		// are pushed out by a thousandth of a pixel so pixel centers exactly on an
+		// edge shared by two triangles are not lost to rounding in both.
+		float a[3], b[3], c[3];
+		for (int k = 0; k < 3; k++)
+		{
+			int next = (k + 1) % 3;
+			a[k] = triangle.y[k] - triangle.y[next];
+			b[k] = triangle.x[next] - triangle.x[k];
+			c[k] = -a[k] * triangle.x[k] - b[k] * triangle.y[k] + (std::fabs(a[k]) + std::fabs(b[k])) * 1e-3f;
+		}
+
+#if OCCLUSIONCULLER_SSE
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 triangleDepth = _mm_set1_ps(triangle.depth);
+		const __m128 laneX = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+		__m128 edgeA[3], edgeStep[3];
+		for (int k = 0; k < 3; k++)
+		{
+			edgeA[k] = _mm_set1_ps(a[k]);
+			edgeStep[k] = _mm_set1_ps(a[k] * 4.0f);
+		}
+
+		for (int y = y0; y <= y1; y++)
+		{
+			float centerY = y + 0.5f;
+			__m128 edge[3];
+			for (int k = 0; k < 3; k++)
+				edge[k] = _mm_add_ps(_mm_mul_ps(edgeA[k], _mm_add_ps(_mm_set1_ps(static_cast<float>(x0)), laneX)), _mm_set1_ps(b[k] * centerY + c[k]));
+
+			float* row = depth + static_cast<size_t>(y) * kWidth;
+			for (int x = x0; x <= x1; x += 4)
+			{
+				__m128 inside = _mm_and_ps(_mm_cmpge_ps(edge[0], zero), _mm_and_ps(_mm_cmpge_ps(edge[1], zero), _mm_cmpge_ps(edge[2], zero)));
+				__m128 current = _mm_loadu_ps(row + x);
+				__m128 nearer = _mm_min_ps(current, triangleDepth);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+				for (int k = 0; k < 3; k++)
+					edge[k] = _mm_add_ps(edge[k], edgeStep[k]);
+			}
+		}
+#else
+		for (int y = y0; y <= y1; y++)
+		{
+			float centerY = y + 0.5f;
+			float* row = depth + static_cast<size_t>(y) * kWidth;
+			for (int x = x0; x <= x1; x++)
+			{
+				float centerX = x + 0.5f;
+				bool inside = true;
+				for (int k = 0; k < 3; k++)
+					inside &= a[k] * centerX + b[k] * centerY + c[k] >= 0.0f;
+				if (inside)
+					row[x] = std::min(row[x], triangle.depth);
+			}
+		}
+#endif
+	}
+}
+
+void OcclusionCuller::BuildHierarchy()
+{
+	for (size_t level = 1; level < m_Levels.size(); level++)
+	{
+		const std::vector<float>& source = m_Levels[level - 1];
+		glm::ivec2 sourceSize = m_LevelSizes[level - 1];
+		glm::ivec2 size = m_LevelSizes[level];
+		std::vector<float>& target = m_Levels[level];
+		target.resize(static_cast<size_t>(size.x) * size.y);
+
+		for (int y = 0; y < size.y; y++)
+		{
+			int y0 = std::min(y * 2, sourceSize.y - 1), y1 = std::min(y * 2 + 1, sourceSize.y - 1);
+			for (int x = 0; x < size.x; x++)
+			{
+				int x0 = std::min(x * 2, sourceSize.x - 1), x1 = std::min(x * 2 + 1, sourceSize.x - 1);
+				target[static_cast<size_t>(y) * size.x + x] = std::max(
+					std::max(source[static_cast<size_t>(y0) * sourceSize.x + x0], source[static_cast<size_t>(y0) * sourceSize.x + x1]),
+					std::max(source[static_cast<size_t>(y1) * sourceSize.x + x0], source[static_cast<size_t>(y1) * sourceSize.x + x1]));
+			}
+		}
+	}
+}
+
+bool OcclusionCuller::IsVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const
+{
+	if (m_Triangles.empty())
+		return true;
+
+	float minX = kFarDepth, minY = kFarDepth, maxX = -kFarDepth, maxY = -kFarDepth;
+	float nearest = kFarDepth;
+	for (int corner = 0; corner < 8; corner++)
+	{
+		glm::vec3 position((corner & 1) ? boundsMax.x : boundsMin.x, (corner & 2) ? boundsMax.y : boundsMin.y, (corner & 4) ? boundsMax.z : boundsMin.z);
+		glm::vec4 clip = m_Transform * glm::vec4(position, 1.0f);
+		// Boxes reaching the camera plane cannot be projected safely
+		if (clip.w < kNearW)
+			return true;
+
+		float x = (clip.x / clip.w * 0.5f + 0.5f) * kWidth;
+		float y = (clip.y / clip.w * 0.5f + 0.5f) * m_Height;
+		minX = std::min(minX, x); maxX = std::max(maxX, x);
+		minY = std::min(minY, y); maxY = std::max(maxY, y);
+		nearest = std::min(nearest, clip.w);
+	}
+
+	// Every pixel the box touches, not only those whose centers it covers
+	int x0 = std::max(0, static_cast<int>(std::floor(minX)));
+	int y0 = std::max(0, static_cast<int>(std::floor(minY)));
+	int x1 = std::min(kWidth - 1, static_cast<int>(std::floor(maxX)));
+	int y1 = std::min(m_Height - 1, static_cast<int>(std::floor(maxY)));
+	if (x0 > x1 || y0 > y1)
+		return true;
+
+	// Coarsest level where the box spans at most 4x4 texels
+	size_t level = 0;
+	while (level + 1 < m_Levels.size() && ((x1 >> level) - (x0 >> level) > 3 || (y1 >> level) - (y0 >> level) > 3))
+		level++;
+
+	const std::vector<float>& depth = m_Levels[level];
+	int width = m_LevelSizes[level].x;
+	for (int y = y0 >> level; y <= (y1 >> level); y++)
+	{
+		for (int x = x0 >> level; x <= (x1 >> level); x++)
+		{
+			if (depth[static_cast<size_t>(y) * width + x] >= nearest)
+				return true;
+		}
+	}
+	return false;
+}
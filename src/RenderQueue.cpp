@@ -0,0 +1,85 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <cstring>
+
+uint64_t RenderQueue::MakeKey(unsigned int pass, unsigned int program, uint32_t material, uint32_t vertexArray, float depth)
+{
+	// Non-negative floats order like their bit patterns; the top 24 bits keep
+	// the exponent and 15 bits of mantissa
+	uint32_t depthBits;
+	depth = std::max(depth, 0.0f);
+	std::memcpy(&depthBits, &depth, sizeof(depthBits));
+
+	return ((uint64_t)(pass & 0xF) << 60)
+		| ((uint64_t)(program & 0xFF) << 52)
+		| ((uint64_t)std::min<uint32_t>(material, 0xFFFFF) << 32)
+		| ((uint64_t)std::min<uint32_t>(vertexArray, 0xFF) << 24)
+		| (uint64_t)(depthBits >> 7);
+}
+
+void RenderQueue::Clear()
+{
+	m_Packets.clear();
+	m_Transforms.clear();
+	m_Runs.Clear();
+	m_InstanceTransforms.clear();
+	m_InstanceLods.clear();
+}
+
+uint32_t RenderQueue::AddTransform(const glm::mat4& transform)
+{
+	m_Transforms.push_back(ObjectData::FromModel(transform));
+	return (uint32_t)(m_Transforms.size() - 1);
+}
+
+uint32_t RenderQueue::AddRuns(const DrawList& list)
+{
+	uint32_t first = (uint32_t)m_Runs.counts.size();
+	m_Runs.counts.insert(m_Runs.counts.end(), list.counts.begin(), list.counts.end());
+	m_Runs.offsets.insert(m_Runs.offsets.end(), list.offsets.begin(), list.offsets.end());
+	m_Runs.baseVertices.insert(m_Runs.baseVertices.end(), list.baseVertices.begin(), list.baseVertices.end());
+	return first;
+}
+
+uint32_t RenderQueue::AddInstances(const ObjectData* instances, const uint8_t* lods, size_t count)
+{
+	uint32_t first = (uint32_t)m_InstanceTransforms.size();
+	m_InstanceTransforms.insert(m_InstanceTransforms.end(), instances, instances + count);
+	m_InstanceLods.insert(m_InstanceLods.end(), lods, lods + count);
+	return first;
+}
+
+void RenderQueue::Sort()
+{
+	size_t count = m_Packets.size();
+	if (count < 2)
+		return;
+
+	// All eight histograms in one read of the keys
+	size_t histograms[8][256] = {};
+	for (const DrawPacket& packet : m_Packets)
+	{
+		for (int digit = 0; digit < 8; digit++)
+			histograms[digit][(packet.key >> (digit * 8)) & 0xFF]++;
+	}
+
+	m_Scratch.resize(count);
+	for (int digit = 0; digit < 8; digit++)
+	{
+		size_t* histogram = histograms[digit];
+		if (histogram[(m_Packets[0].key >> (digit * 8)) & 0xFF] == count)
+			continue;
+
+		size_t offset = 0;
+		for (int bucket = 0; bucket < 256; bucket++)
+		{
+			size_t bucketCount = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += bucketCount;
+		}
+		for (const DrawPacket& packet : m_Packets)
+			m_Scratch[histogram[(packet.key >> (digit * 8)) & 0xFF]++] = packet;
+		m_Packets.swap(m_Scratch);
+	}
+}
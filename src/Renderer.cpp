@@ -1,6 +1,17 @@
 #include "Renderer.h"
+#include <cstring>
 #include <iostream>
 
+RendererCaps Renderer::s_Caps;
+RenderStats Renderer::s_Stats;
+UniformBuffer* Renderer::s_FrameBuffer = nullptr;
+UniformBuffer* Renderer::s_ObjectBuffer = nullptr;
+size_t Renderer::s_ObjectSlot = 0;
+bool Renderer::s_FaceCullingEnabled = false;
+
+// Object slots in the ring before it is orphaned and refilled from the start
+static const size_t kObjectSlots = 256;
+
 void GLClearError()
 {
 	while (glGetError() != GL_NO_ERROR);
@@ -15,4 +26,183 @@ bool GLLogCall(const char* function, const char* file, int line)
 		return false;
 	}
 	return true;
+}
+
+// The GLCall being made, for the debug callback; function is null between calls
+struct GLCallSite
+{
+	const char* function = nullptr;
+	const char* file = nullptr;
+	int line = 0;
+};
+
+static GLCallSite s_CallSite;
+// Set by Init when errors arrive through the debug callback rather than glGetError
+static bool s_DebugOutput = false;
+
+void GLBeginCall(const char* function, const char* file, int line)
+{
+	s_CallSite.function = function;
+	s_CallSite.file = file;
+	s_CallSite.line = line;
+	if (!s_DebugOutput)
+		GLClearError();
+}
+
+void GLEndCall()
+{
+	if (!s_DebugOutput && !GLLogCall(s_CallSite.function, s_CallSite.file, s_CallSite.line))
+		DEBUG_BREAK();
+	s_CallSite.function = nullptr;
+}
+
+#if MODELVIEWER_GL_CHECKS == 1
+static void APIENTRY GLDebugCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length,
+	const GLchar* message, const void* userParam)
+{
+	(void)source; (void)severity; (void)length; (void)userParam;
+
+	std::cout << (type == GL_DEBUG_TYPE_ERROR ? "[OpenGL Error] (" : "[OpenGL] (") << id << "): " << message << std::endl;
+	if (s_CallSite.function)
+		std::cout << "    in " << s_CallSite.function << " " << s_CallSite.file << ":" << s_CallSite.line << std::endl;
+	else
+		std::cout << "    outside GLCall" << std::endl;
+
+	if (type == GL_DEBUG_TYPE_ERROR)
+		DEBUG_BREAK();
+}
+
+// Needs a debug context; synchronous output makes the callback run inside the
+// offending call, so the recorded call site is the right one
+static bool EnableDebugOutput()
+{
+	if (!GLAD_GL_VERSION_4_3)
+		return false;
+
+	GLint flags = 0;
+	glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+	if (!(flags & GL_CONTEXT_FLAG_DEBUG_BIT))
+		return false;
+
+	glEnable(GL_DEBUG_OUTPUT);
+	glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	glDebugMessageCallback(GLDebugCallback, nullptr);
+	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+	return true;
+}
+#endif
+
+void Renderer::Init()
+{
+#if MODELVIEWER_GL_CHECKS == 1
+	s_DebugOutput = EnableDebugOutput();
+#endif
+
+	GLint extensionCount = 0;
+	GLCall(glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount));
+	for (GLint i = 0; i < extensionCount; i++)
+	{
+		const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+		if (!name)
+			continue;
+		if (std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0)
+			s_Caps.textureCompressionS3TC = true;
+		else if (std::strcmp(name, "GL_ARB_texture_compression_rgtc") == 0)
+			s_Caps.textureCompressionRGTC = true;
+		else if (std::strcmp(name, "GL_ARB_texture_compression_bptc") == 0)
+			s_Caps.textureCompressionBPTC = true;
+		else if (std::strcmp(name, "GL_KHR_parallel_shader_compile") == 0 || std::strcmp(name, "GL_ARB_parallel_shader_compile") == 0)
+			s_Caps.parallelShaderCompile = true;
+	}
+
+	// RGTC is core since 3.0 and BPTC since 4.2
+	s_Caps.textureCompressionRGTC |= GLAD_GL_VERSION_3_0 != 0;
+	s_Caps.textureCompressionBPTC |= GLAD_GL_VERSION_4_2 != 0;
+
+	if (GLAD_GL_VERSION_4_1)
+	{
+		GLint binaryFormats = 0;
+		GLCall(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats));
+		s_Caps.programBinary = binaryFormats > 0;
+	}
+
+	std::cout << "OpenGL " << glGetString(GL_VERSION) << " on " << glGetString(GL_RENDERER) << std::endl;
+	std::cout << "Texture compression: S3TC " << s_Caps.textureCompressionS3TC << ", RGTC " << s_Caps.textureCompressionRGTC
+		<< ", BPTC " << s_Caps.textureCompressionBPTC << std::endl;
+	std::cout << "Program binaries: " << s_Caps.programBinary << ", parallel shader compile: " << s_Caps.parallelShaderCompile << std::endl;
+	std::cout << "GL error checks: " << GetErrorCheckMode() << std::endl;
+
+	s_FrameBuffer = new UniformBuffer(sizeof(FrameData));
+	s_FrameBuffer->BindBase(UNIFORM_BINDING_FRAME);
+	s_ObjectBuffer = new UniformBuffer(kObjectSlots * UniformBuffer::Align(sizeof(ObjectData)));
+	SetObjectTransform(glm::mat4(1.0f));
+}
+
+void Renderer::Shutdown()
+{
+	delete s_FrameBuffer;
+	delete s_ObjectBuffer;
+	s_FrameBuffer = s_ObjectBuffer = nullptr;
+}
+
+void Renderer::SetFrameData(const FrameData& frame)
+{
+	s_FrameBuffer->SetData(&frame, sizeof(frame));
+	s_FrameBuffer->BindBase(UNIFORM_BINDING_FRAME);
+}
+
+void Renderer::SetObjectTransform(const glm::mat4& model)
+{
+	if (s_ObjectSlot == kObjectSlots)
+	{
+		s_ObjectBuffer->SetData(nullptr, s_ObjectBuffer->GetSize());
+		s_ObjectSlot = 0;
+	}
+
+	ObjectData object = ObjectData::FromModel(model);
+	size_t offset = s_ObjectSlot++ * UniformBuffer::Align(sizeof(ObjectData));
+	s_ObjectBuffer->SetSubData(&object, sizeof(object), offset);
+	s_ObjectBuffer->BindRange(UNIFORM_BINDING_OBJECT, offset, sizeof(object));
+}
+
+void Renderer::EnableFaceCulling(bool enable)
+{
+	if (enable)
+	{
+		GLCall(glEnable(GL_CULL_FACE));
+	}
+	else
+	{
+		GLCall(glDisable(GL_CULL_FACE));
+	}
+	s_FaceCullingEnabled = enable;
+}
+
+bool Renderer::IsFaceCullingEnabled()
+{
+	return s_FaceCullingEnabled;
+}
+
+const char* Renderer::GetErrorCheckMode()
+{
+#if MODELVIEWER_GL_CHECKS
+	return s_DebugOutput ? "debug output" : "glGetError per call";
+#else
+	return "off";
+#endif
+}
+
+const RendererCaps& Renderer::GetCaps()
+{
+	return s_Caps;
+}
+
+RenderStats& Renderer::GetStats()
+{
+	return s_Stats;
+}
+
+void Renderer::ResetStats()
+{
+	s_Stats = RenderStats();
 }
\ No newline at end of file
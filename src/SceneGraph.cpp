@@ -0,0 +1,120 @@
+#include "SceneGraph.h"
+#include "ThreadPool.h"
+
+namespace
+{
+	// Subtrees smaller than this are updated by whichever thread reaches them
+	const int kMinParallelNodes = 4096;
+}
+
+int SceneGraph::AddNode(int parent, const glm::mat4& local, const std::string& name)
+{
+	int node = static_cast<int>(m_Parents.size());
+	m_Parents.push_back(parent);
+	m_SubtreeEnds.push_back(node + 1);
+	m_Names.push_back(name);
+	m_Local.push_back(local);
+	m_World.push_back(parent == kNoParent ? local : m_World[parent] * local);
+	m_Dirty.push_back(0);
+
+	for (int ancestor = parent; ancestor != kNoParent; ancestor = m_Parents[ancestor])
+		m_SubtreeEnds[ancestor] = node + 1;
+	return node;
+}
+
+void SceneGraph::Clear()
+{
+	m_Parents.clear();
+	m_SubtreeEnds.clear();
+	m_Names.clear();
+	m_Local.clear();
+	m_World.clear();
+	m_Dirty.clear();
+	m_AnyDirty = false;
+}
+
+void SceneGraph::SetLocal(int node, const glm::mat4& local)
+{
+	m_Local[node] = local;
+	m_Dirty[node] = 1;
+	m_AnyDirty = true;
+}
+
+int SceneGraph::FindNode(const std::string& name) const
+{
+	for (size_t i = 0; i < m_Names.size(); i++)
+	{
+		if (m_Names[i] == name)
+			return static_cast<int>(i);
+	}
+	return kNoParent;
+}
+
+void SceneGraph::UpdateRange(int begin, int end)
+{
+	// Parents precede children, and the parent of begin lies outside the
+	// range and is already final, so one forward pass is enough
+	for (int node = begin; node < end; node++)
+	{
+		int parent = m_Parents[node];
+		m_World[node] = parent == kNoParent ? m_Local[node] : m_World[parent] * m_Local[node];
+		m_Dirty[node] = 0;
+	}
+}
+
+size_t SceneGraph::Update()
+{
+	if (!m_AnyDirty)
+		return 0;
+	m_AnyDirty = false;
+
+	// Topmost dirty nodes; everything below them is recomputed anyway
+	std::vector<int> roots;
+	int nodeCount = static_cast<int>(m_Parents.size());
+	for (int node = 0; node < nodeCount;)
+	{
+		if (m_Dirty[node])
+		{
+			roots.push_back(node);
+			node = m_SubtreeEnds[node];
+		}
+		else
+			node++;
+	}
+
+	// Big subtrees are opened up: their root is done here and each child
+	// subtree becomes a job of its own, until every job is small
+	std::vector<int> jobs;
+	size_t updated = 0;
+	while (!roots.empty())
+	{
+		int root = roots.back();
+		roots.pop_back();
+		int end = m_SubtreeEnds[root];
+		if (end - root < kMinParallelNodes)
+		{
+			jobs.push_back(root);
+			updated += end - root;
+			continue;
+		}
+
+		UpdateRange(root, root + 1);
+		updated++;
+		for (int child = root + 1; child < end; child = m_SubtreeEnds[child])
+			roots.push_back(child);
+	}
+
+	if (updated < static_cast<size_t>(kMinParallelNodes))
+	{
+		for (int root : jobs)
+			UpdateRange(root, m_SubtreeEnds[root]);
+		return updated;
+	}
+
+	// Model::Draw calls this every frame on the GL thread, which must not pick up import jobs
+	ThreadPool::Get().ParallelForIsolated(jobs.size(), [this, &jobs](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			UpdateRange(jobs[i], m_SubtreeEnds[jobs[i]]);
+	});
+	return updated;
+}
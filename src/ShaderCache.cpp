@@ -0,0 +1,157 @@
+#include "ShaderCache.h"
+
+#include "Renderer.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	const char kMagic[4] = { 'M', 'V', 'S', 'C' };
+	const uint32_t kVersion = 1;
+
+	struct FileHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t key;
+		uint32_t binaryFormat;
+		uint32_t binaryLength;
+	};
+
+	uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	uint64_t HashString(uint64_t hash, const char* value)
+	{
+		// The length keeps "ab" + "c" and "a" + "bc" apart
+		uint64_t length = value ? std::strlen(value) : 0;
+		hash = HashBytes(hash, &length, sizeof(length));
+		return HashBytes(hash, value, length);
+	}
+}
+
+std::string ShaderCache::s_Directory = "cache/shaders";
+
+void ShaderCache::SetDirectory(const std::string& directory)
+{
+	s_Directory = directory;
+}
+
+bool ShaderCache::IsSupported()
+{
+	return Renderer::GetCaps().programBinary;
+}
+
+uint64_t ShaderCache::GetKey(const std::string& vertexSource, const std::string& fragmentSource)
+{
+	uint64_t hash = 14695981039346656037ull;
+	hash = HashString(hash, vertexSource.c_str());
+	hash = HashString(hash, fragmentSource.c_str());
+	hash = HashString(hash, reinterpret_cast<const char*>(glGetString(GL_VENDOR)));
+	hash = HashString(hash, reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+	hash = HashString(hash, reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+	hash = HashBytes(hash, &kVersion, sizeof(kVersion));
+	return hash;
+}
+
+std::string ShaderCache::GetEntryPath(uint64_t key)
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.mvsc", static_cast<unsigned long long>(key));
+	return (fs::path(s_Directory) / name).string();
+}
+
+bool ShaderCache::Load(uint64_t key, unsigned int program)
+{
+	if (!IsSupported())
+		return false;
+
+	std::string entryPath = GetEntryPath(key);
+	std::ifstream in(entryPath, std::ios::binary);
+	if (!in)
+		return false;
+
+	FileHeader header;
+	in.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!in || std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion || header.key != key)
+		return false;
+
+	std::vector<char> binary(header.binaryLength);
+	in.read(binary.data(), binary.size());
+	if (!in)
+		return false;
+
+	// The driver may still reject a binary it wrote, e.g. after an update that
+	// kept the version string; the caller then compiles from source
+	GLCall(glProgramBinary(program, header.binaryFormat, binary.data(), (GLsizei)binary.size()));
+	GLint linked = GL_FALSE;
+	GLCall(glGetProgramiv(program, GL_LINK_STATUS, &linked));
+	if (!linked)
+	{
+		std::error_code error;
+		fs::remove(entryPath, error);
+		return false;
+	}
+	return true;
+}
+
+bool ShaderCache::Store(uint64_t key, unsigned int program)
+{
+	if (!IsSupported())
+		return false;
+
+	GLint linked = GL_FALSE, length = 0;
+	GLCall(glGetProgramiv(program, GL_LINK_STATUS, &linked));
+	GLCall(glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length));
+	if (!linked || length <= 0)
+		return false;
+
+	FileHeader header = {};
+	std::memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.version = kVersion;
+	header.key = key;
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	GLsizei written = 0;
+	GLCall(glGetProgramBinary(program, length, &written, &format, binary.data()));
+	header.binaryFormat = format;
+	header.binaryLength = (uint32_t)written;
+
+	std::error_code error;
+	fs::create_directories(s_Directory, error);
+	std::string entryPath = GetEntryPath(key);
+	std::string tempPath = entryPath + ".tmp";
+	{
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(binary.data(), written);
+		if (!out)
+		{
+			std::cout << "Failed to write shader cache entry: " << tempPath << std::endl;
+			return false;
+		}
+	}
+
+	fs::rename(tempPath, entryPath, error);
+	if (error)
+	{
+		fs::remove(tempPath, error);
+		return false;
+	}
+	return true;
+}
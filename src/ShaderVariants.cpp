@@ -0,0 +1,79 @@
+#include "ShaderVariants.h"
+
+#include "Mesh.h"
+
+#include <iostream>
+
+ShaderVariants::ShaderVariants(const std::string& path, Shader& fallback)
+	: m_Path(path), m_Fallback(fallback)
+{
+}
+
+std::vector<std::string> ShaderVariants::GetDefines(unsigned int features)
+{
+	std::vector<std::string> defines;
+	if (features & SHADER_FEATURE_NORMALS)
+		defines.push_back("HAS_NORMALS");
+	if (features & SHADER_FEATURE_TEXCOORDS)
+		defines.push_back("HAS_TEXCOORDS");
+	if (features & SHADER_FEATURE_DIFFUSE_MAP)
+		defines.push_back("HAS_DIFFUSE_MAP");
+	if (features & SHADER_FEATURE_SPECULAR_MAP)
+		defines.push_back("HAS_SPECULAR_MAP");
+	return defines;
+}
+
+unsigned int ShaderVariants::GetVertexAttributes(unsigned int features)
+{
+	unsigned int attributes = VERTEX_ATTRIBUTE_POSITION;
+	if (features & SHADER_FEATURE_NORMALS)
+		attributes |= VERTEX_ATTRIBUTE_NORMAL;
+	if (features & SHADER_FEATURE_TEXCOORDS)
+		attributes |= VERTEX_ATTRIBUTE_TEXCOORD;
+	return attributes;
+}
+
+Shader& ShaderVariants::Get(unsigned int features)
+{
+	std::unique_ptr<Shader>& variant = m_Variants[GetProgramId(features)];
+	if (!variant)
+		variant = std::make_unique<Shader>(m_Path, GetDefines(features));
+	return variant->isReady() ? *variant : m_Fallback;
+}
+
+void ShaderVariants::Update()
+{
+	for (unsigned int features = 0; features <= SHADER_FEATURE_ALL; features++)
+	{
+		std::unique_ptr<Shader>& variant = m_Variants[features];
+		if (!variant || variant->getStatus() != SHADER_STATUS_READY || m_Checked[features])
+			continue;
+
+		// Attribute locations are the VERTEX_ATTRIBUTE_* bits. Import skips what
+		// GetVertexAttributes leaves out, so a variant must not read more.
+		unsigned int unexpected = variant->getActiveAttributeMask() & VERTEX_ATTRIBUTE_ALL & ~GetVertexAttributes(features);
+		if (unexpected)
+			std::cout << "WARNING::SHADER: variant " << features << " of " << m_Path << " reads vertex attributes 0x"
+				<< std::hex << unexpected << std::dec << " its features do not provide" << std::endl;
+		m_Checked[features] = true;
+	}
+}
+
+size_t ShaderVariants::GetVariantCount() const
+{
+	size_t count = 0;
+	for (const std::unique_ptr<Shader>& variant : m_Variants)
+		count += variant ? 1 : 0;
+	return count;
+}
+
+double ShaderVariants::GetBuildMs() const
+{
+	double total = 0.0;
+	for (const std::unique_ptr<Shader>& variant : m_Variants)
+	{
+		if (variant && variant->isReady())
+			total += variant->getBuildMs();
+	}
+	return total;
+}
@@ -0,0 +1,335 @@
+#include "TextureCache.h"
+#include "MappedFile.h"
+#include "Renderer.h"
+#include "ThreadPool.h"
+#include "stb_image.h"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+static uint64_t HashContents(const unsigned char* data, size_t size)
+{
+	uint64_t hash = 14695981039346656037ull ^ size;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= data[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// A hash match is only a candidate; the bytes decide
+static bool SameContents(const std::string& pathA, const std::string& pathB)
+{
+	if (pathA == pathB)
+		return true;
+	MappedFile a, b;
+	if (!a.Open(pathA) || !b.Open(pathB) || a.GetSize() != b.GetSize())
+		return false;
+	return std::memcmp(a.GetData(), b.GetData(), a.GetSize()) == 0;
+}
+
+static bool HasTransparency(const ImageRGBA8& image)
+{
+	for (size_t i = 3; i < image.pixels.size(); i += 4)
+	{
+		if (image.pixels[i] != 255)
+			return true;
+	}
+	return false;
+}
+
+static void UploadCompressed(unsigned int textureID, const CompressedImage& image)
+{
+	GLCall(glBindTexture(GL_TEXTURE_2D, textureID));
+	for (size_t level = 0; level < image.levels.size(); level++)
+	{
+		const CompressedLevel& data = image.levels[level];
+		GLCall(glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, image.format, data.width, data.height, 0, (GLsizei)data.data.size(), data.data.data()));
+	}
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1));
+
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT));
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT));
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR));
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+}
+
+void UploadTexture(unsigned int textureID, const DecodedImage& image)
+{
+	if (!image.compressed.levels.empty())
+	{
+		UploadCompressed(textureID, image.compressed);
+		return;
+	}
+
+	// Levels are RGBA8 and filtered on a worker, so each one is a plain aligned copy
+	GLCall(glBindTexture(GL_TEXTURE_2D, textureID));
+	for (size_t level = 0; level < image.levels.size(); level++)
+	{
+		const ImageRGBA8& data = image.levels[level];
+		GLCall(glTexImage2D(GL_TEXTURE_2D, (GLint)level, GL_RGBA, data.width, data.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data.pixels.data()));
+	}
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1));
+
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT));
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT));
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR));
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+}
+
+TextureCache& TextureCache::Get()
+{
+	static TextureCache cache;
+	return cache;
+}
+
+TextureCache::~TextureCache()
+{
+	// GL textures die with the context; only wait for in-flight decodes here
+	for (auto& decode : m_Decodes)
+		decode.second.image.wait();
+}
+
+std::string TextureCache::Canonicalize(const std::string& filename)
+{
+	std::error_code error;
+	std::filesystem::path canonical = std::filesystem::weakly_canonical(std::filesystem::absolute(filename, error), error);
+	return error ? filename : canonical.string();
+}
+
+std::string TextureCache::MakeKey(const std::string& path, TextureRole role)
+{
+	return path + '#' + std::to_string((int)role);
+}
+
+uint64_t TextureCache::MakeContentKey(uint64_t contentHash, TextureRole role)
+{
+	return contentHash ^ ((uint64_t)(role + 1) * 0x9E3779B97F4A7C15ull);
+}
+
+TextureCache::Decode TextureCache::StartDecode(const std::string& path, TextureRole role)
+{
+	std::string key = MakeKey(path, role);
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto found = m_Decodes.find(key);
+	if (found != m_Decodes.end())
+		return found->second;
+
+	// One job reads and hashes the file, publishes the hash early so Acquire()
+	// can match duplicates, then decodes from the same mapping
+	auto hash = std::make_shared<std::promise<uint64_t>>();
+	Decode decode;
+	decode.contentHash = hash->get_future().share();
+	decode.image = ThreadPool::Get().Submit([path, role, hash]() {
+		MappedFile file;
+		if (!file.Open(path))
+		{
+			hash->set_value(0);
+			return DecodedImage();
+		}
+		uint64_t contentHash = HashContents(file.GetData(), file.GetSize());
+		hash->set_value(contentHash);
+
+		// Blocks from an earlier run skip both decoding and encoding
+		DecodedImage image;
+		bool compress = TextureCompressor::IsEnabled();
+		if (compress && TextureCompressor::LoadCached(contentHash, role, image.compressed))
+		{
+			image.width = image.compressed.levels[0].width;
+			image.height = image.compressed.levels[0].height;
+			return image;
+		}
+
+		stbi_set_flip_vertically_on_load_thread(0);
+		unsigned char* data = stbi_load_from_memory(file.GetData(), (int)file.GetSize(), &image.width, &image.height, &image.channels, 0);
+		if (!data)
+			return image;
+		ImageRGBA8 rgba = MipChain::ExpandToRGBA(data, image.width, image.height, image.channels);
+		stbi_image_free(data);
+
+		// Only colour maps are gamma encoded; data maps are filtered as stored
+		bool hasAlpha = HasTransparency(rgba);
+		std::vector<ImageRGBA8> levels = MipChain::Build(std::move(rgba), MIP_FILTER_KAISER, role == TEXTURE_ROLE_DIFFUSE);
+
+		GLenum format = compress ? TextureCompressor::ChooseFormat(role, image.channels, hasAlpha) : 0;
+		if (format && TextureCompressor::Compress(levels, format, image.compressed))
+		{
+			TextureCompressor::StoreCached(contentHash, role, image.compressed);
+			return image;
+		}
+		image.levels = std::move(levels);
+		return image;
+	}).share();
+
+	m_Decodes.emplace(key, decode);
+	return decode;
+}
+
+void TextureCache::Prefetch(const std::string& filename, TextureRole role)
+{
+	std::string path = Canonicalize(filename);
+	std::string key = MakeKey(path, role);
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (m_ByPath.count(key) || m_Decodes.count(key))
+			return;
+	}
+	StartDecode(path, role);
+}
+
+unsigned int TextureCache::Acquire(const std::string& filename, TextureRole role)
+{
+	std::string path = Canonicalize(filename);
+	std::string key = MakeKey(path, role);
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		auto byPath = m_ByPath.find(key);
+		if (byPath != m_ByPath.end())
+		{
+			m_Entries[byPath->second].refCount++;
+			m_Stats.pathHits++;
+			return byPath->second;
+		}
+	}
+
+	// A prefetched path usually has its hash by now. If not, the content match
+	// is left to Update() rather than waiting here for the file to be read.
+	Decode decode = StartDecode(path, role);
+	uint64_t contentKey = 0;
+	if (decode.contentHash.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+	{
+		uint64_t contentHash = decode.contentHash.get();
+		contentKey = contentHash ? MakeContentKey(contentHash, role) : 0;
+	}
+
+	auto byContent = contentKey ? m_ByContent.find(contentKey) : m_ByContent.end();
+	if (byContent != m_ByContent.end() && SameContents(path, m_Entries[byContent->second].sourcePath))
+	{
+		Entry& entry = m_Entries[byContent->second];
+		entry.refCount++;
+		entry.paths.push_back(key);
+		m_Stats.contentHits++;
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_ByPath.emplace(key, byContent->second);
+		m_Decodes.erase(key);
+		return byContent->second;
+	}
+
+	unsigned int textureID;
+	GLCall(glGenTextures(1, &textureID));
+
+	// 1x1 white placeholder, replaced in Update() once decoding finishes
+	unsigned char whitePixel[] = { 255, 255, 255 };
+	GLCall(glBindTexture(GL_TEXTURE_2D, textureID));
+	GLCall(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, whitePixel));
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+
+	Entry& entry = m_Entries[textureID];
+	entry.refCount = 1;
+	entry.residentBytes = 3;
+	entry.sourcePath = path;
+	entry.paths.push_back(key);
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_ByPath.emplace(key, textureID);
+	}
+	// After a collision the first texture keeps the content slot
+	if (contentKey && m_ByContent.emplace(contentKey, textureID).second)
+		entry.contentHash = contentKey;
+
+	m_Stats.misses++;
+	m_Stats.textureCount = m_Entries.size();
+	m_Stats.residentBytes += entry.residentBytes;
+
+	m_Pending.push_back({ textureID, role, key, path, decode.contentHash, decode.image });
+	return textureID;
+}
+
+void TextureCache::Release(unsigned int textureID)
+{
+	auto found = m_Entries.find(textureID);
+	if (found == m_Entries.end() || --found->second.refCount > 0)
+		return;
+
+	Entry& entry = found->second;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (const std::string& path : entry.paths)
+			m_ByPath.erase(path);
+	}
+	if (entry.contentHash)
+		m_ByContent.erase(entry.contentHash);
+
+	for (size_t i = 0; i < m_Pending.size(); i++)
+	{
+		if (m_Pending[i].textureID == textureID)
+		{
+			{
+				// The decode would otherwise keep its pixels for good
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_Decodes.erase(m_Pending[i].key);
+			}
+			m_Pending[i] = std::move(m_Pending.back());
+			m_Pending.pop_back();
+			break;
+		}
+	}
+
+	m_Stats.residentBytes -= entry.residentBytes;
+	m_Entries.erase(found);
+	m_Stats.textureCount = m_Entries.size();
+
+	GLCall(glDeleteTextures(1, &textureID));
+}
+
+void TextureCache::Update()
+{
+	for (size_t i = 0; i < m_Pending.size();)
+	{
+		PendingUpload& upload = m_Pending[i];
+		if (upload.image.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			i++;
+			continue;
+		}
+
+		// Acquired before its hash was known: later acquires of the same
+		// contents can still share it
+		Entry& entry = m_Entries[upload.textureID];
+		uint64_t contentHash = upload.contentHash.get();
+		uint64_t contentKey = contentHash ? MakeContentKey(contentHash, upload.role) : 0;
+		if (!entry.contentHash && contentKey && m_ByContent.emplace(contentKey, upload.textureID).second)
+			entry.contentHash = contentKey;
+
+		const DecodedImage& image = upload.image.get();
+		if (image.IsValid())
+		{
+			UploadTexture(upload.textureID, image);
+
+			m_Stats.residentBytes -= entry.residentBytes;
+			entry.residentBytes = 0;
+			for (const CompressedLevel& level : image.compressed.levels)
+				entry.residentBytes += level.data.size();
+			for (const ImageRGBA8& level : image.levels)
+				entry.residentBytes += level.pixels.size();
+			m_Stats.residentBytes += entry.residentBytes;
+		}
+		else
+			std::cout << "Failed to load texture: " << upload.path << ". Using white texture.\n";
+
+		{
+			// Later acquires of this path hit m_ByPath, so the pixels can go
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Decodes.erase(upload.key);
+		}
+
+		upload = std::move(m_Pending.back());
+		m_Pending.pop_back();
+	}
+}
@@ -0,0 +1,532 @@
+#include "TextureCompressor.h"
+#include "MappedFile.h"
+#include "Renderer.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+	const char kMagic[4] = { 'M', 'V', 'T', 'C' };
+	const uint32_t kVersion = 2;
+
+	struct Block
+	{
+		float rgba[16][4];
+	};
+
+	struct FileHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t format;
+		uint32_t levelCount;
+	};
+
+	struct LevelHeader
+	{
+		uint32_t width;
+		uint32_t height;
+		uint32_t size;
+	};
+
+	// BC7 4-bit index interpolation weights
+	const int kWeights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	void LoadBlock(const ImageRGBA8& image, int blockX, int blockY, Block& block)
+	{
+		for (int y = 0; y < 4; y++)
+		{
+			int sy = std::min(blockY * 4 + y, image.height - 1);
+			for (int x = 0; x < 4; x++)
+			{
+				int sx = std::min(blockX * 4 + x, image.width - 1);
+				const unsigned char* pixel = &image.pixels[(static_cast<size_t>(sy) * image.width + sx) * 4];
+				for (int c = 0; c < 4; c++)
+					block.rgba[y * 4 + x][c] = pixel[c];
+			}
+		}
+	}
+
+	// Endpoints at the extremes of the block's principal axis over the first channels
+	void FindEndpoints(const Block& block, int channels, float low[4], float high[4])
+	{
+		float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; i++)
+			for (int c = 0; c < channels; c++)
+				mean[c] += block.rgba[i][c] / 16.0f;
+
+		float covariance[4][4] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			for (int a = 0; a < channels; a++)
+				for (int b = 0; b < channels; b++)
+					covariance[a][b] += (block.rgba[i][a] - mean[a]) * (block.rgba[i][b] - mean[b]);
+		}
+
+		float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		for (int iteration = 0; iteration < 8; iteration++)
+		{
+			float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			float length = 0.0f;
+			for (int a = 0; a < channels; a++)
+			{
+				for (int b = 0; b < channels; b++)
+					next[a] += covariance[a][b] * axis[b];
+				length = std::max(length, std::fabs(next[a]));
+			}
+			if (length < 1e-6f)
+				break;
+			for (int a = 0; a < channels; a++)
+				axis[a] = next[a] / length;
+		}
+
+		float norm = 0.0f;
+		for (int c = 0; c < channels; c++)
+			norm += axis[c] * axis[c];
+		norm = std::sqrt(norm);
+		for (int c = 0; c < channels; c++)
+			axis[c] = norm > 0.0f ? axis[c] / norm : 0.0f;
+
+		float minT = 0.0f, maxT = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			float t = 0.0f;
+			for (int c = 0; c < channels; c++)
+				t += (block.rgba[i][c] - mean[c]) * axis[c];
+			minT = std::min(minT, t);
+			maxT = std::max(maxT, t);
+		}
+
+		for (int c = 0; c < channels; c++)
+		{
+			low[c] = std::clamp(mean[c] + axis[c] * minT, 0.0f, 255.0f);
+			high[c] = std::clamp(mean[c] + axis[c] * maxT, 0.0f, 255.0f);
+		}
+	}
+
+	uint16_t To565(const float color[3])
+	{
+		int r = std::clamp(static_cast<int>(color[0] * 31.0f / 255.0f + 0.5f), 0, 31);
+		int g = std::clamp(static_cast<int>(color[1] * 63.0f / 255.0f + 0.5f), 0, 63);
+		int b = std::clamp(static_cast<int>(color[2] * 31.0f / 255.0f + 0.5f), 0, 31);
+		return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+	}
+
+	void From565(uint16_t value, int color[3])
+	{
+		int r = (value >> 11) & 31, g = (value >> 5) & 63, b = value & 31;
+		color[0] = (r << 3) | (r >> 2);
+		color[1] = (g << 2) | (g >> 4);
+		color[2] = (b << 3) | (b >> 2);
+	}
+
+	void EncodeBC1(const Block& block, unsigned char* out)
+	{
+		float low[4], high[4];
+		FindEndpoints(block, 3, low, high);
+
+		uint16_t color0 = To565(high), color1 = To565(low);
+		if (color0 < color1)
+			std::swap(color0, color1);
+
+		uint32_t indices = 0;
+		if (color0 != color1)
+		{
+			// color0 > color1 selects the opaque four-color palette
+			int palette[4][3];
+			From565(color0, palette[0]);
+			From565(color1, palette[1]);
+			for (int c = 0; c < 3; c++)
+			{
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+
+			for (int i = 0; i < 16; i++)
+			{
+				int best = 0;
+				float bestError = 1e30f;
+				for (int p = 0; p < 4; p++)
+				{
+					float error = 0.0f;
+					for (int c = 0; c < 3; c++)
+					{
+						float d = block.rgba[i][c] - palette[p][c];
+						error += d * d;
+					}
+					if (error < bestError)
+					{
+						bestError = error;
+						best = p;
+					}
+				}
+				indices |= static_cast<uint32_t>(best) << (2 * i);
+			}
+		}
+
+		out[0] = color0 & 0xFF;
+		out[1] = color0 >> 8;
+		out[2] = color1 & 0xFF;
+		out[3] = color1 >> 8;
+		for (int i = 0; i < 4; i++)
+			out[4 + i] = (indices >> (8 * i)) & 0xFF;
+	}
+
+	void EncodeBC4(const Block& block, int channel, unsigned char* out)
+	{
+		float minValue = 255.0f, maxValue = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			minValue = std::min(minValue, block.rgba[i][channel]);
+			maxValue = std::max(maxValue, block.rgba[i][channel]);
+		}
+
+		int value0 = static_cast<int>(maxValue + 0.5f);
+		int value1 = static_cast<int>(minValue + 0.5f);
+		uint64_t indices = 0;
+		if (value0 > value1)
+		{
+			// value0 > value1 selects the eight-value palette
+			int palette[8] = { value0, value1 };
+			for (int i = 1; i <= 6; i++)
+				palette[i + 1] = ((7 - i) * value0 + i * value1) / 7;
+
+			for (int i = 0; i < 16; i++)
+			{
+				int best = 0;
+				float bestError = 1e30f;
+				for (int p = 0; p < 8; p++)
+				{
+					float error = std::fabs(block.rgba[i][channel] - palette[p]);
+					if (error < bestError)
+					{
+						bestError = error;
+						best = p;
+					}
+				}
+				indices |= static_cast<uint64_t>(best) << (3 * i);
+			}
+		}
+
+		out[0] = static_cast<unsigned char>(value0);
+		out[1] = static_cast<unsigned char>(value1);
+		for (int i = 0; i < 6; i++)
+			out[2 + i] = (indices >> (8 * i)) & 0xFF;
+	}
+
+	class BitWriter
+	{
+	private:
+		unsigned char* m_Out;
+		int m_Position;
+	public:
+		explicit BitWriter(unsigned char* out)
+			: m_Out(out), m_Position(0)
+		{
+			std::memset(out, 0, 16);
+		}
+
+		void Write(uint32_t value, int bits)
+		{
+			for (int i = 0; i < bits; i++, m_Position++)
+				m_Out[m_Position >> 3] |= ((value >> i) & 1) << (m_Position & 7);
+		}
+	};
+
+	// BC7 mode 6: one subset, 7-bit RGBA endpoints with a p-bit each, 4-bit indices
+	void EncodeBC7(const Block& block, unsigned char* out)
+	{
+		float endpoints[2][4];
+		FindEndpoints(block, 4, endpoints[0], endpoints[1]);
+
+		int quantized[2][4];
+		int pbits[2];
+		for (int e = 0; e < 2; e++)
+		{
+			float bestError = 1e30f;
+			for (int p = 0; p < 2; p++)
+			{
+				int candidate[4];
+				float error = 0.0f;
+				for (int c = 0; c < 4; c++)
+				{
+					candidate[c] = std::clamp(static_cast<int>((endpoints[e][c] - p) / 2.0f + 0.5f), 0, 127);
+					float d = static_cast<float>((candidate[c] << 1) | p) - endpoints[e][c];
+					error += d * d;
+				}
+				if (error < bestError)
+				{
+					bestError = error;
+					pbits[e] = p;
+					std::copy(candidate, candidate + 4, quantized[e]);
+				}
+			}
+		}
+
+		int palette[16][4];
+		for (int c = 0; c < 4; c++)
+		{
+			int e0 = (quantized[0][c] << 1) | pbits[0];
+			int e1 = (quantized[1][c] << 1) | pbits[1];
+			for (int i = 0; i < 16; i++)
+				palette[i][c] = ((64 - kWeights4[i]) * e0 + kWeights4[i] * e1 + 32) >> 6;
+		}
+
+		int indices[16];
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0;
+			float bestError = 1e30f;
+			for (int p = 0; p < 16; p++)
+			{
+				float error = 0.0f;
+				for (int c = 0; c < 4; c++)
+				{
+					float d = block.rgba[i][c] - palette[p][c];
+					error += d * d;
+				}
+				if (error < bestError)
+				{
+					bestError = error;
+					best = p;
+				}
+			}
+			indices[i] = best;
+		}
+
+		// The anchor index is stored with its top bit implied zero
+		if (indices[0] & 8)
+		{
+			std::swap(quantized[0], quantized[1]);
+			std::swap(pbits[0], pbits[1]);
+			for (int i = 0; i < 16; i++)
+				indices[i] = 15 - indices[i];
+		}
+
+		BitWriter writer(out);
+		writer.Write(1u << 6, 7);
+		for (int c = 0; c < 4; c++)
+		{
+			writer.Write(quantized[0][c], 7);
+			writer.Write(quantized[1][c], 7);
+		}
+		writer.Write(pbits[0], 1);
+		writer.Write(pbits[1], 1);
+		writer.Write(indices[0], 3);
+		for (int i = 1; i < 16; i++)
+			writer.Write(indices[i], 4);
+	}
+
+	void EncodeBlock(const Block& block, GLenum format, unsigned char* out)
+	{
+		switch (format)
+		{
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+			EncodeBC1(block, out);
+			break;
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+			EncodeBC4(block, 3, out);
+			EncodeBC1(block, out + 8);
+			break;
+		case GL_COMPRESSED_RED_RGTC1:
+			EncodeBC4(block, 0, out);
+			break;
+		case GL_COMPRESSED_RG_RGTC2:
+			EncodeBC4(block, 0, out);
+			EncodeBC4(block, 1, out + 8);
+			break;
+		case GL_COMPRESSED_RGBA_BPTC_UNORM:
+			EncodeBC7(block, out);
+			break;
+		}
+	}
+}
+
+bool TextureCompressor::s_Enabled = true;
+
+void TextureCompressor::SetEnabled(bool enabled)
+{
+	s_Enabled = enabled;
+}
+
+bool TextureCompressor::IsEnabled()
+{
+	return s_Enabled;
+}
+
+TextureRole TextureRoleFromType(const std::string& type)
+{
+	if (type == "texture_specular")
+		return TEXTURE_ROLE_SPECULAR;
+	if (type == "texture_normal")
+		return TEXTURE_ROLE_NORMAL;
+	if (type == "texture_height")
+		return TEXTURE_ROLE_HEIGHT;
+	return TEXTURE_ROLE_DIFFUSE;
+}
+
+GLenum TextureCompressor::ChooseFormat(TextureRole role, int channels, bool hasAlpha)
+{
+	const RendererCaps& caps = Renderer::GetCaps();
+	switch (role)
+	{
+	case TEXTURE_ROLE_NORMAL:
+		// Two channels; Z is reconstructed when the map is sampled
+		return caps.textureCompressionRGTC ? GL_COMPRESSED_RG_RGTC2 : 0;
+	case TEXTURE_ROLE_SPECULAR:
+	case TEXTURE_ROLE_HEIGHT:
+		if (channels == 1)
+			return caps.textureCompressionRGTC ? GL_COMPRESSED_RED_RGTC1 : 0;
+		return caps.textureCompressionS3TC ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : 0;
+	case TEXTURE_ROLE_DIFFUSE:
+	default:
+		if (hasAlpha)
+		{
+			if (caps.textureCompressionBPTC)
+				return GL_COMPRESSED_RGBA_BPTC_UNORM;
+			return caps.textureCompressionS3TC ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : 0;
+		}
+		return caps.textureCompressionS3TC ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : 0;
+	}
+}
+
+size_t TextureCompressor::GetBlockSize(GLenum format)
+{
+	switch (format)
+	{
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_RED_RGTC1:
+		return 8;
+	default:
+		return 16;
+	}
+}
+
+bool TextureCompressor::Compress(const std::vector<ImageRGBA8>& levels, GLenum format, CompressedImage& out)
+{
+	if (levels.empty() || format == 0)
+		return false;
+
+	out.format = format;
+	out.levels.clear();
+	size_t blockSize = GetBlockSize(format);
+
+	for (const ImageRGBA8& level : levels)
+	{
+		int blocksX = (level.width + 3) / 4;
+		int blocksY = (level.height + 3) / 4;
+
+		CompressedLevel compressed;
+		compressed.width = level.width;
+		compressed.height = level.height;
+		compressed.data.resize(static_cast<size_t>(blocksX) * blocksY * blockSize);
+
+		ThreadPool::Get().ParallelFor(static_cast<size_t>(blocksY), [&](size_t begin, size_t end) {
+			Block block;
+			for (size_t by = begin; by < end; by++)
+			{
+				for (int bx = 0; bx < blocksX; bx++)
+				{
+					LoadBlock(level, bx, static_cast<int>(by), block);
+					EncodeBlock(block, format, &compressed.data[(by * blocksX + bx) * blockSize]);
+				}
+			}
+		});
+		out.levels.push_back(std::move(compressed));
+	}
+	return true;
+}
+
+std::string TextureCompressor::GetCachePath(uint64_t contentHash, TextureRole role)
+{
+	char name[48];
+	std::snprintf(name, sizeof(name), "%016llx-%d.mvtc", static_cast<unsigned long long>(contentHash), static_cast<int>(role));
+	return (std::filesystem::path("cache/textures") / name).string();
+}
+
+bool TextureCompressor::LoadCached(uint64_t contentHash, TextureRole role, CompressedImage& out)
+{
+	MappedFile file;
+	if (!file.Open(GetCachePath(contentHash, role)))
+		return false;
+
+	const unsigned char* data = file.GetData();
+	size_t size = file.GetSize();
+
+	FileHeader header;
+	if (size < sizeof(header))
+		return false;
+	std::memcpy(&header, data, sizeof(header));
+	if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion)
+		return false;
+
+	// The cache may have been written on a driver with more formats; only take
+	// blocks this one would have chosen, or they fail to upload
+	bool usable = false;
+	for (int channels : { 1, 3 })
+	{
+		for (bool hasAlpha : { false, true })
+			usable |= header.format != 0 && ChooseFormat(role, channels, hasAlpha) == header.format;
+	}
+	if (!usable)
+		return false;
+
+	size_t cursor = sizeof(header);
+	out.format = header.format;
+	out.levels.resize(header.levelCount);
+	for (CompressedLevel& level : out.levels)
+	{
+		LevelHeader levelHeader;
+		if (cursor + sizeof(levelHeader) > size)
+			return false;
+		std::memcpy(&levelHeader, data + cursor, sizeof(levelHeader));
+		cursor += sizeof(levelHeader);
+		if (cursor + levelHeader.size > size)
+			return false;
+
+		level.width = static_cast<int>(levelHeader.width);
+		level.height = static_cast<int>(levelHeader.height);
+		level.data.assign(data + cursor, data + cursor + levelHeader.size);
+		cursor += levelHeader.size;
+	}
+	return !out.levels.empty();
+}
+
+bool TextureCompressor::StoreCached(uint64_t contentHash, TextureRole role, const CompressedImage& image)
+{
+	std::error_code error;
+	std::filesystem::create_directories("cache/textures", error);
+
+	std::string path = GetCachePath(contentHash, role);
+	std::string tempPath = path + ".tmp";
+	{
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		if (!out)
+			return false;
+
+		FileHeader header;
+		std::memcpy(header.magic, kMagic, sizeof(kMagic));
+		header.version = kVersion;
+		header.format = image.format;
+		header.levelCount = static_cast<uint32_t>(image.levels.size());
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		for (const CompressedLevel& level : image.levels)
+		{
+			LevelHeader levelHeader = { static_cast<uint32_t>(level.width), static_cast<uint32_t>(level.height), static_cast<uint32_t>(level.data.size()) };
+			out.write(reinterpret_cast<const char*>(&levelHeader), sizeof(levelHeader));
+			out.write(reinterpret_cast<const char*>(level.data.data()), level.data.size());
+		}
+		if (!out)
+			return false;
+	}
+
+	std::filesystem::rename(tempPath, path, error);
+	return !error;
+}
@@ -0,0 +1,75 @@
+#include "UniformBuffer.h"
+
+#include "Renderer.h"
+
+#include <algorithm>
+
+ObjectData ObjectData::FromModel(const glm::mat4& model)
+{
+	ObjectData data;
+	data.model = model;
+	glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+	for (int column = 0; column < 3; column++)
+		data.normalMatrix[column] = glm::vec4(normalMatrix[column], 0.0f);
+	return data;
+}
+
+UniformBuffer::UniformBuffer(size_t size)
+	: m_RendererID(0), m_Size(size)
+{
+	GLCall(glGenBuffers(1, &m_RendererID));
+	GLCall(glBindBuffer(GL_UNIFORM_BUFFER, m_RendererID));
+	GLCall(glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW));
+}
+
+UniformBuffer::~UniformBuffer()
+{
+	GLCall(glDeleteBuffers(1, &m_RendererID));
+}
+
+void UniformBuffer::SetData(const void* data, size_t size)
+{
+	// Respecifying the store lets the driver hand out fresh memory instead of
+	// waiting for draws still reading the old contents
+	m_Size = std::max(m_Size, size);
+	GLCall(glBindBuffer(GL_UNIFORM_BUFFER, m_RendererID));
+	GLCall(glBufferData(GL_UNIFORM_BUFFER, m_Size, nullptr, GL_DYNAMIC_DRAW));
+	if (data)
+	{
+		GLCall(glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data));
+	}
+}
+
+void UniformBuffer::SetSubData(const void* data, size_t size, size_t offset)
+{
+	GLCall(glBindBuffer(GL_UNIFORM_BUFFER, m_RendererID));
+	GLCall(glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data));
+}
+
+void UniformBuffer::BindBase(unsigned int binding) const
+{
+	GLCall(glBindBufferBase(GL_UNIFORM_BUFFER, binding, m_RendererID));
+}
+
+void UniformBuffer::BindRange(unsigned int binding, size_t offset, size_t size) const
+{
+	GLCall(glBindBufferRange(GL_UNIFORM_BUFFER, binding, m_RendererID, offset, size));
+}
+
+size_t UniformBuffer::GetOffsetAlignment()
+{
+	static size_t alignment = 0;
+	if (alignment == 0)
+	{
+		GLint value = 0;
+		GLCall(glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &value));
+		alignment = value > 0 ? (size_t)value : 256;
+	}
+	return alignment;
+}
+
+size_t UniformBuffer::Align(size_t size)
+{
+	size_t alignment = GetOffsetAlignment();
+	return (size + alignment - 1) / alignment * alignment;
+}
@@ -0,0 +1,309 @@
+#include "VertexFormat.h"
+#include "Meshlet.h"
+#include "Renderer.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	const size_t kMaxShortVertices = 65536;
+
+	struct SplitResult
+	{
+		std::vector<unsigned int> vertexOrder;
+		std::vector<uint16_t> indices;
+		std::vector<DrawRange> ranges;
+	};
+
+	// Greedy cut in triangle order into ranges of at most 65536 vertices.
+	// After vertex fetch optimization most vertices stay in their own range.
+	// Every level of detail starts a new range so levels can be drawn alone.
+	void SplitForShortIndices(size_t vertexCount, const unsigned int* indices, const std::vector<MeshLod>& lods, SplitResult& out,
+		std::vector<DrawLod>& drawLods)
+	{
+		const unsigned int unused = ~0u;
+		std::vector<unsigned int> local(vertexCount, unused);
+		std::vector<unsigned int> stamp(vertexCount, 0);
+		unsigned int chunk = 0;
+		size_t chunkStart = 0, indexStart = 0;
+
+		for (const MeshLod& lod : lods)
+		{
+			drawLods.push_back({ out.ranges.size(), 0, 0, 0, lod.error });
+			chunk++;
+			chunkStart = out.vertexOrder.size();
+			indexStart = out.indices.size();
+
+			size_t indexEnd = lod.indexOffset + lod.indexCount;
+			for (size_t t = lod.indexOffset; t + 2 < indexEnd; t += 3)
+			{
+				size_t added = 0;
+				for (int k = 0; k < 3; k++)
+				{
+					unsigned int v = indices[t + k];
+					if (stamp[v] != chunk && std::find(indices + t, indices + t + k, v) == indices + t + k)
+						added++;
+				}
+
+				if (out.vertexOrder.size() - chunkStart + added > kMaxShortVertices)
+				{
+					out.ranges.push_back({ indexStart, out.indices.size() - indexStart, static_cast<int>(chunkStart) });
+					chunk++;
+					chunkStart = out.vertexOrder.size();
+					indexStart = out.indices.size();
+				}
+
+				for (int k = 0; k < 3; k++)
+				{
+					unsigned int v = indices[t + k];
+					if (stamp[v] != chunk)
+					{
+						stamp[v] = chunk;
+						local[v] = static_cast<unsigned int>(out.vertexOrder.size() - chunkStart);
+						out.vertexOrder.push_back(v);
+					}
+					out.indices.push_back(static_cast<uint16_t>(local[v]));
+				}
+			}
+			out.ranges.push_back({ indexStart, out.indices.size() - indexStart, static_cast<int>(chunkStart) });
+			drawLods.back().rangeCount = out.ranges.size() - drawLods.back().firstRange;
+		}
+	}
+
+	void EncodeVertices(const Vertex* vertices, const unsigned int* order, size_t count, const glm::vec3& offset, const glm::vec3& scale, CompactVertex* out)
+	{
+		glm::vec3 inverseScale = 1.0f / scale;
+		ThreadPool::Get().ParallelFor(count, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+			{
+				const Vertex& vertex = vertices[order ? order[i] : i];
+				CompactVertex& compact = out[i];
+
+				glm::vec3 position = glm::clamp((vertex.Position - offset) * inverseScale, 0.0f, 1.0f);
+				for (int c = 0; c < 3; c++)
+					compact.Position[c] = static_cast<uint16_t>(position[c] * 65535.0f + 0.5f);
+				compact.Position[3] = 0;
+
+				glm::vec2 normal = VertexFormat::EncodeOctahedral(vertex.Normal);
+				compact.Normal[0] = static_cast<int16_t>(std::round(glm::clamp(normal.x, -1.0f, 1.0f) * 32767.0f));
+				compact.Normal[1] = static_cast<int16_t>(std::round(glm::clamp(normal.y, -1.0f, 1.0f) * 32767.0f));
+
+				compact.TexCoords[0] = VertexFormat::FloatToHalf(vertex.TexCoords.x);
+				compact.TexCoords[1] = VertexFormat::FloatToHalf(vertex.TexCoords.y);
+			}
+		}, 16384);
+	}
+}
+
+bool VertexFormat::s_Compact = false;
+
+void VertexFormat::SetCompact(bool compact)
+{
+	s_Compact = compact;
+}
+
+bool VertexFormat::IsCompact()
+{
+	return s_Compact;
+}
+
+uint16_t VertexFormat::FloatToHalf(float value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+
+	uint32_t sign = (bits >> 16) & 0x8000;
+	int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xFF) - 127 + 15;
+	uint32_t mantissa = bits & 0x7FFFFF;
+
+	if (((bits >> 23) & 0xFF) == 0xFF)
+		return static_cast<uint16_t>(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+	if (exponent >= 31)
+		return static_cast<uint16_t>(sign | 0x7C00);
+	if (exponent <= 0)
+	{
+		// Subnormal or zero
+		if (exponent < -10)
+			return static_cast<uint16_t>(sign);
+		mantissa |= 0x800000;
+		uint32_t shift = static_cast<uint32_t>(14 - exponent);
+		uint32_t half = mantissa >> shift;
+		uint32_t remainder = mantissa & ((1u << shift) - 1);
+		uint32_t midpoint = 1u << (shift - 1);
+		if (remainder > midpoint || (remainder == midpoint && (half & 1)))
+			half++;
+		return static_cast<uint16_t>(sign | half);
+	}
+
+	// Round to nearest even; a mantissa carry correctly bumps the exponent
+	uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+	uint32_t remainder = mantissa & 0x1FFF;
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+		half++;
+	return static_cast<uint16_t>(half);
+}
+
+glm::vec2 VertexFormat::EncodeOctahedral(const glm::vec3& normal)
+{
+	float length = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+	// (0, 0) would decode to +Z; zero normals become +Y, as the vertex shader
+	// substitutes for them in full-precision meshes
+	if (length == 0.0f)
+		return glm::vec2(0.0f, 1.0f);
+
+	glm::vec2 result = glm::vec2(normal.x, normal.y) / length;
+	if (normal.z < 0.0f)
+	{
+		glm::vec2 folded(1.0f - std::fabs(result.y), 1.0f - std::fabs(result.x));
+		result.x = result.x >= 0.0f ? folded.x : -folded.x;
+		result.y = result.y >= 0.0f ? folded.y : -folded.y;
+	}
+	return result;
+}
+
+PackedMesh VertexFormat::Pack(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount,
+	const MeshLod* lods, size_t lodCount)
+{
+	PackedMesh packed;
+	packed.compact = s_Compact;
+	packed.vertexCount = vertexCount;
+	packed.indexCount = indexCount;
+
+	std::vector<MeshLod> levels(lods, lods + lodCount);
+	if (levels.empty())
+		levels.push_back({ 0, indexCount, 0.0f });
+
+	// Box for frustum culling, and a sphere around its center to project LOD errors
+	if (vertexCount > 0)
+	{
+		glm::vec3 boundsMin = vertices[0].Position, boundsMax = vertices[0].Position;
+		for (size_t i = 1; i < vertexCount; i++)
+		{
+			boundsMin = glm::min(boundsMin, vertices[i].Position);
+			boundsMax = glm::max(boundsMax, vertices[i].Position);
+		}
+		packed.boundsMin = boundsMin;
+		packed.boundsMax = boundsMax;
+		packed.boundsCenter = (boundsMin + boundsMax) * 0.5f;
+		float radiusSquared = 0.0f;
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			glm::vec3 offset = vertices[i].Position - packed.boundsCenter;
+			radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+		}
+		packed.boundsRadius = std::sqrt(radiusSquared);
+	}
+
+	SplitResult split;
+	bool shortIndices = vertexCount <= kMaxShortVertices;
+	if (!shortIndices && s_Compact)
+	{
+		// Worth it when the halved index buffer saves more than the border copies cost
+		std::vector<DrawLod> splitLods;
+		SplitForShortIndices(vertexCount, indices, levels, split, splitLods);
+		size_t extraBytes = (split.vertexOrder.size() - vertexCount) * sizeof(CompactVertex);
+		size_t savedBytes = indexCount * (sizeof(uint32_t) - sizeof(uint16_t));
+		if (savedBytes > extraBytes)
+		{
+			packed.vertexCount = split.vertexOrder.size();
+			packed.indexCount = split.indices.size();
+			packed.ranges = split.ranges;
+			packed.lods = splitLods;
+			packed.indexType = GL_UNSIGNED_SHORT;
+			packed.indexStorage.resize(split.indices.size() * sizeof(uint16_t));
+			std::memcpy(packed.indexStorage.data(), split.indices.data(), packed.indexStorage.size());
+		}
+		else
+			split.vertexOrder.clear();
+	}
+
+	if (packed.ranges.empty())
+	{
+		for (const MeshLod& level : levels)
+		{
+			packed.lods.push_back({ packed.ranges.size(), 1, 0, 0, level.error });
+			packed.ranges.push_back({ level.indexOffset, level.indexCount, 0 });
+		}
+		if (shortIndices)
+		{
+			packed.indexType = GL_UNSIGNED_SHORT;
+			packed.indexStorage.resize(indexCount * sizeof(uint16_t));
+			uint16_t* out = reinterpret_cast<uint16_t*>(packed.indexStorage.data());
+			for (size_t i = 0; i < indexCount; i++)
+				out[i] = static_cast<uint16_t>(indices[i]);
+		}
+		else
+			packed.indexData = indices;
+	}
+	if (!packed.indexStorage.empty())
+		packed.indexData = packed.indexStorage.data();
+
+	const unsigned int* order = split.vertexOrder.empty() ? nullptr : split.vertexOrder.data();
+	for (DrawLod& lod : packed.lods)
+	{
+		lod.firstMeshlet = packed.meshlets.size();
+		for (size_t i = lod.firstRange; i < lod.firstRange + lod.rangeCount; i++)
+			MeshletBuilder::Build(vertices, order, packed.vertexCount, packed.indexData, packed.indexType, packed.ranges[i], packed.meshlets);
+		lod.meshletCount = packed.meshlets.size() - lod.firstMeshlet;
+	}
+
+	if (!s_Compact)
+	{
+		packed.vertexData = vertices;
+		return packed;
+	}
+
+	packed.positionOffset = packed.boundsMin;
+	packed.positionScale = glm::max(packed.boundsMax - packed.boundsMin, glm::vec3(1e-6f));
+
+	packed.vertexStorage.resize(packed.vertexCount * sizeof(CompactVertex));
+	EncodeVertices(vertices, split.vertexOrder.empty() ? nullptr : split.vertexOrder.data(), packed.vertexCount,
+		packed.positionOffset, packed.positionScale, reinterpret_cast<CompactVertex*>(packed.vertexStorage.data()));
+	packed.vertexData = packed.vertexStorage.data();
+	return packed;
+}
+
+void VertexFormat::SetupAttributes(bool compact)
+{
+	GLCall(glEnableVertexAttribArray(0));
+	GLCall(glEnableVertexAttribArray(1));
+	GLCall(glEnableVertexAttribArray(2));
+	if (compact)
+	{
+		GLCall(glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, Position)));
+		GLCall(glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, Normal)));
+		GLCall(glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, TexCoords)));
+	}
+	else
+	{
+		GLCall(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Position)));
+		GLCall(glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal)));
+		GLCall(glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords)));
+	}
+}
+
+void VertexFormat::UploadIdentityInstance(unsigned int buffer)
+{
+	ObjectData identity = ObjectData::FromModel(glm::mat4(1.0f));
+	GLCall(glBindBuffer(GL_ARRAY_BUFFER, buffer));
+	GLCall(glBufferData(GL_ARRAY_BUFFER, sizeof(identity), &identity, GL_STREAM_DRAW));
+}
+
+void VertexFormat::SetupInstanceAttributes(size_t offset)
+{
+	for (unsigned int column = 0; column < 4; column++)
+	{
+		GLCall(glEnableVertexAttribArray(3 + column));
+		GLCall(glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(ObjectData), (void*)(offset + offsetof(ObjectData, model) + column * sizeof(glm::vec4))));
+		GLCall(glVertexAttribDivisor(3 + column, 1));
+	}
+	for (unsigned int column = 0; column < 3; column++)
+	{
+		GLCall(glEnableVertexAttribArray(7 + column));
+		GLCall(glVertexAttribPointer(7 + column, 3, GL_FLOAT, GL_FALSE, sizeof(ObjectData), (void*)(offset + offsetof(ObjectData, normalMatrix) + column * sizeof(glm::vec4))));
+		GLCall(glVertexAttribDivisor(7 + column, 1));
+	}
+}
@@ -34,6 +34,11 @@ glm::mat4 Camera::GetViewMatrix()
 	return glm::lookAt(position, position + front, up);
 }
 
+Frustum Camera::GetFrustum(float aspect, float nearPlane, float farPlane)
+{
+	return Frustum::FromMatrix(glm::perspective(glm::radians(zoom), aspect, nearPlane, farPlane) * GetViewMatrix());
+}
+
 void Camera::ProcessKeyboardEvent(CAMERA_MOVEMENT direction, float deltaTime)
 {
 	float velocity = movementSpeed * deltaTime;
@@ -84,4 +89,31 @@ void Camera::updateCameraVectors()
 
 	right = glm::normalize(glm::cross(front, worldUp));
 	up = glm::normalize(glm::cross(right, front));
-}
\ No newline at end of file
+}
+Frustum Frustum::FromMatrix(const glm::mat4& matrix)
+{
+	// Gribb & Hartmann: each plane is the last row of the matrix plus or minus another row
+	Frustum frustum;
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+		rows[i] = glm::vec4(matrix[0][i], matrix[1][i], matrix[2][i], matrix[3][i]);
+
+	for (int i = 0; i < 3; i++)
+	{
+		frustum.planes[i * 2] = rows[3] + rows[i];
+		frustum.planes[i * 2 + 1] = rows[3] - rows[i];
+	}
+	for (glm::vec4& plane : frustum.planes)
+		plane /= glm::length(glm::vec3(plane));
+	return frustum;
+}
+
+bool Frustum::IntersectsSphere(const glm::vec3& center, float radius) const
+{
+	for (const glm::vec4& plane : planes)
+	{
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+			return false;
+	}
+	return true;
+}
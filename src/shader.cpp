@@ -1,93 +1,386 @@
 #include "Shader.h"
+#include "Renderer.h"
+#include "ShaderCache.h"
+#include "UniformBuffer.h"
 
-Shader::Shader()
-{
-	const char* vertexShaderSource = R"(
-#version 330 core
-layout(location = 0) in vec3 aPos;
-layout(location = 1) in vec3 aNormal;
-layout(location = 2) in vec2 aTexCoord;
-
-out vec3 FragPos;
-out vec3 Normal;
-out vec2 TexCoord;
-
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-void main()
-{
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
-    TexCoord = aTexCoord;
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-}
-)";
-
-	const char* fragmentShaderSource = R"(
-#version 330 core
-out vec4 FragColor;
-
-in vec3 FragPos;
-in vec3 Normal;
-in vec2 TexCoord;
-
-uniform vec3 lightPos = vec3(2.0, 4.0, 2.0);
-uniform vec3 lightColor = vec3(1.0, 1.0, 1.0);
-uniform vec3 viewPos = vec3(0.0, 0.0, 3.0);
-uniform vec3 objectColor = vec3(0.7, 0.7, 0.7);
-
-void main()
-{
-    // Ambient lighting
-    float ambientStrength = 0.3;
-    vec3 ambient = ambientStrength * lightColor;
-    
-    // Diffuse lighting
-    vec3 norm = normalize(Normal);
-    vec3 lightDir = normalize(lightPos - FragPos);
-    float diff = max(dot(norm, lightDir), 0.0);
-    vec3 diffuse = diff * lightColor;
-    
-    // Specular lighting
-    float specularStrength = 0.5;
-    vec3 viewDir = normalize(viewPos - FragPos);
-    vec3 reflectDir = reflect(-lightDir, norm);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
-    vec3 specular = specularStrength * spec * lightColor;
-    
-    // Combine all lighting components
-    vec3 result = (ambient + diffuse + specular) * objectColor;
-    FragColor = vec4(result, 1.0);
-}
-)";
-
-	unsigned int vertex, fragment;
-	int success;
-	char infoLog[512];
+#include <algorithm>
+#include <filesystem>
+#include <set>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+// From KHR_parallel_shader_compile (same value as the ARB token); the loader
+// only carries core GL
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// Polls before a status query when completion cannot be asked without waiting
+static const unsigned int kDeferredPolls = 3;
+
+namespace
+{
+	bool ReadFile(const fs::path& path, std::string& contents)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+		std::stringstream stream;
+		stream << file.rdbuf();
+		contents = stream.str();
+		return true;
+	}
+
+	// Replaces #include "file" lines, relative to the including file, with the
+	// file's contents. Each file is pasted once per stage.
+	void ResolveIncludes(const std::string& source, const fs::path& directory, std::set<std::string>& included, std::string& out)
+	{
+		std::istringstream lines(source);
+		std::string line;
+		while (std::getline(lines, line))
+		{
+			size_t start = line.find_first_not_of(" \t");
+			if (start == std::string::npos || line.compare(start, 8, "#include") != 0)
+			{
+				out += line;
+				out += '\n';
+				continue;
+			}
+
+			size_t open = line.find('"', start);
+			size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+			if (close == std::string::npos)
+			{
+				std::cout << "ERROR::SHADER: malformed include: " << line << std::endl;
+				throw std::runtime_error("Malformed shader include: " + line);
+			}
+
+			fs::path includePath = directory / line.substr(open + 1, close - open - 1);
+			std::error_code error;
+			std::string key = fs::weakly_canonical(includePath, error).string();
+			if (!included.insert(error ? includePath.string() : key).second)
+				continue;
+
+			std::string contents;
+			if (!ReadFile(includePath, contents))
+			{
+				std::cout << "ERROR::SHADER: cannot read include " << includePath.string() << std::endl;
+				throw std::runtime_error("Cannot read shader include: " + includePath.string());
+			}
+			ResolveIncludes(contents, includePath.parent_path(), included, out);
+		}
+	}
+
+	// #version has to stay the first directive, so the defines go after it
+	void InsertDefines(const std::vector<std::string>& defines, std::string& source)
+	{
+		if (defines.empty())
+			return;
+
+		std::string block;
+		for (const std::string& define : defines)
+			block += "#define " + define + "\n";
+
+		size_t position = 0;
+		size_t version = source.find("#version");
+		if (version != std::string::npos)
+		{
+			size_t end = source.find('\n', version);
+			position = end == std::string::npos ? source.size() : end + 1;
+		}
+		source.insert(position, block);
+	}
+}
+
+Shader::Shader(const std::string& path, const std::vector<std::string>& defines)
+	: ID(0), m_Path(path), m_Name(path), m_Status(SHADER_STATUS_COMPILING), m_Vertex(0), m_Fragment(0), m_CacheKey(0), m_Polls(0),
+	  m_BuildMs(0.0), m_Restored(false)
+{
+	for (const std::string& define : defines)
+		m_Name += " " + define;
+
+	std::string vertexSource, fragmentSource;
+	loadSource(path, defines, vertexSource, fragmentSource);
+
+	ID = glCreateProgram();
+	m_CacheKey = ShaderCache::GetKey(vertexSource, fragmentSource);
+	if (ShaderCache::Load(m_CacheKey, ID))
+	{
+		finish(true);
+		return;
+	}
+
+	// Compile and link are only submitted here; their status is read once the
+	// driver reports completion, so the calls return without waiting
+	const char* vertexShaderSource = vertexSource.c_str();
+	const char* fragmentShaderSource = fragmentSource.c_str();
 
 	// Vertex shader
-	vertex = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertex, 1, &vertexShaderSource, NULL);
-	glCompileShader(vertex);
-	checkCompileErrors(vertex, "VERTEX");
+	m_Vertex = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(m_Vertex, 1, &vertexShaderSource, NULL);
+	glCompileShader(m_Vertex);
 
 	// Fragment shader
-	fragment = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragment, 1, &fragmentShaderSource, NULL);
-	glCompileShader(fragment);
-	checkCompileErrors(fragment, "FRAGMENT");
+	m_Fragment = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(m_Fragment, 1, &fragmentShaderSource, NULL);
+	glCompileShader(m_Fragment);
 
 	// Shader program
-	ID = glCreateProgram();
-	glAttachShader(ID, vertex);
-	glAttachShader(ID, fragment);
+	glAttachShader(ID, m_Vertex);
+	glAttachShader(ID, m_Fragment);
+	if (ShaderCache::IsSupported())
+		glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(ID);
-	checkCompileErrors(ID, "PROGRAM");
+}
+
+Shader::~Shader()
+{
+	if (m_Vertex)
+		glDeleteShader(m_Vertex);
+	if (m_Fragment)
+		glDeleteShader(m_Fragment);
+	glDeleteProgram(ID);
+}
+
+ShaderStatus Shader::getStatus()
+{
+	if (m_Status != SHADER_STATUS_COMPILING)
+		return m_Status;
+
+	if (Renderer::GetCaps().parallelShaderCompile)
+	{
+		GLint complete = GL_FALSE;
+		glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &complete);
+		if (!complete)
+			return m_Status;
+	}
+	// Without the extension any status query waits for the compile. Asking
+	// only after a few polls leaves drivers that compile on their own threads
+	// time to finish first.
+	else if (++m_Polls < kDeferredPolls)
+		return m_Status;
+
+	finish(false);
+	return m_Status;
+}
+
+void Shader::wait()
+{
+	if (m_Status == SHADER_STATUS_COMPILING)
+		finish(false);
+}
+
+void Shader::finish(bool restored)
+{
+	bool linked = restored;
+	if (!restored)
+	{
+		bool compiled = checkCompileErrors(m_Vertex, "VERTEX");
+		compiled &= checkCompileErrors(m_Fragment, "FRAGMENT");
+		linked = compiled && checkCompileErrors(ID, "PROGRAM");
+
+		glDetachShader(ID, m_Vertex);
+		glDetachShader(ID, m_Fragment);
+		glDeleteShader(m_Vertex);
+		glDeleteShader(m_Fragment);
+		m_Vertex = m_Fragment = 0;
+	}
+
+	if (!linked)
+	{
+		m_Status = SHADER_STATUS_FAILED;
+		std::cout << "Shader " << m_Name << " failed to build" << std::endl;
+		return;
+	}
+
+	if (!restored)
+		ShaderCache::Store(m_CacheKey, ID);
+	reflect();
+	m_Status = SHADER_STATUS_READY;
 
-	glDeleteShader(vertex);
-	glDeleteShader(fragment);
+	// Cold times run from submission to the completed check, so they include
+	// any frames drawn meanwhile
+	m_BuildMs = m_Timer.ElapsedMs();
+	m_Restored = restored;
+	std::cout << "Shader " << m_Name << (restored ? " restored from program binary" : " compiled and linked")
+		<< " in " << m_BuildMs << " ms (" << (restored ? "warm" : "cold") << ")" << std::endl;
+}
+
+void Shader::loadSource(const std::string& path, const std::vector<std::string>& defines, std::string& vertexSource, std::string& fragmentSource)
+{
+	std::string contents;
+	if (!ReadFile(path, contents))
+	{
+		std::cout << "ERROR::SHADER: cannot read " << path << std::endl;
+		throw std::runtime_error("Cannot read shader: " + path);
+	}
+
+	// Stages start at "#shader vertex" and "#shader fragment" lines
+	std::string stages[2];
+	int stage = -1;
+	std::istringstream lines(contents);
+	std::string line;
+	while (std::getline(lines, line))
+	{
+		if (line.compare(0, 7, "#shader") == 0)
+		{
+			if (line.find("vertex") != std::string::npos)
+				stage = 0;
+			else if (line.find("fragment") != std::string::npos)
+				stage = 1;
+			else
+				stage = -1;
+			continue;
+		}
+		if (stage >= 0)
+		{
+			stages[stage] += line;
+			stages[stage] += '\n';
+		}
+	}
+	if (stages[0].empty() || stages[1].empty())
+	{
+		std::cout << "ERROR::SHADER: " << path << " needs a vertex and a fragment section" << std::endl;
+		throw std::runtime_error("Incomplete shader: " + path);
+	}
+
+	fs::path directory = fs::path(path).parent_path();
+	std::set<std::string> included;
+	ResolveIncludes(stages[0], directory, included, vertexSource);
+	included.clear();
+	ResolveIncludes(stages[1], directory, included, fragmentSource);
+	InsertDefines(defines, vertexSource);
+	InsertDefines(defines, fragmentSource);
+}
+
+void Shader::reflect()
+{
+	m_Uniforms.clear();
+	m_Attributes.clear();
+
+	char name[256];
+	GLsizei length;
+	GLint size;
+	GLenum type;
+
+	int count = 0;
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+	for (int i = 0; i < count; i++)
+	{
+		glGetActiveUniform(ID, i, sizeof(name), &length, &size, &type, name);
+		GLint location = glGetUniformLocation(ID, name);
+		if (location < 0)
+			continue;
+
+		// Arrays are reported as "name[0]"; elements follow on consecutive locations
+		std::string base(name, length);
+		if (base.size() > 3 && base.compare(base.size() - 3, 3, "[0]") == 0)
+		{
+			base.resize(base.size() - 3);
+			m_Uniforms.push_back({ ShaderNameHash(base.c_str()), location, type });
+			for (GLint element = 0; element < size; element++)
+			{
+				std::string elementName = base + "[" + std::to_string(element) + "]";
+				m_Uniforms.push_back({ ShaderNameHash(elementName.c_str()), location + element, type });
+			}
+		}
+		else
+			m_Uniforms.push_back({ ShaderNameHash(base.c_str()), location, type });
+	}
+
+	glGetProgramiv(ID, GL_ACTIVE_ATTRIBUTES, &count);
+	for (int i = 0; i < count; i++)
+	{
+		glGetActiveAttrib(ID, i, sizeof(name), &length, &size, &type, name);
+		GLint location = glGetAttribLocation(ID, name);
+		if (location >= 0)
+			m_Attributes.push_back({ ShaderNameHash(name), location, type });
+	}
+
+	// Uniform blocks go to the binding points shared by every program
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+	for (int i = 0; i < count; i++)
+	{
+		glGetActiveUniformBlockName(ID, i, sizeof(name), &length, name);
+		uint32_t nameHash = ShaderNameHash(name);
+		if (nameHash == SHADER_NAME("FrameData"))
+			glUniformBlockBinding(ID, i, UNIFORM_BINDING_FRAME);
+		else if (nameHash == SHADER_NAME("ObjectData"))
+			glUniformBlockBinding(ID, i, UNIFORM_BINDING_OBJECT);
+		else
+			std::cout << "WARNING::SHADER: no binding point for uniform block " << name << std::endl;
+	}
+
+	auto byHash = [](const Variable& a, const Variable& b) { return a.nameHash < b.nameHash; };
+	std::sort(m_Uniforms.begin(), m_Uniforms.end(), byHash);
+	std::sort(m_Attributes.begin(), m_Attributes.end(), byHash);
+	for (size_t i = 1; i < m_Uniforms.size(); i++)
+	{
+		if (m_Uniforms[i].nameHash == m_Uniforms[i - 1].nameHash && m_Uniforms[i].location != m_Uniforms[i - 1].location)
+			std::cout << "WARNING::SHADER: two uniforms share the name hash " << m_Uniforms[i].nameHash << std::endl;
+	}
+}
+
+GLint Shader::getUniformLocation(uint32_t nameHash) const
+{
+	auto it = std::lower_bound(m_Uniforms.begin(), m_Uniforms.end(), nameHash,
+		[](const Variable& uniform, uint32_t hash) { return uniform.nameHash < hash; });
+	return it != m_Uniforms.end() && it->nameHash == nameHash ? it->location : -1;
+}
+
+void Shader::set(ShaderUniform<bool> uniform, bool value) const
+{
+	if (uniform.isValid())
+		glUniform1i(uniform.location, (int)value);
+}
+
+void Shader::set(ShaderUniform<int> uniform, int value) const
+{
+	if (uniform.isValid())
+		glUniform1i(uniform.location, value);
+}
+
+void Shader::set(ShaderUniform<float> uniform, float value) const
+{
+	if (uniform.isValid())
+		glUniform1f(uniform.location, value);
+}
+
+void Shader::set(ShaderUniform<glm::vec2> uniform, const glm::vec2& value) const
+{
+	if (uniform.isValid())
+		glUniform2fv(uniform.location, 1, &value[0]);
+}
+
+void Shader::set(ShaderUniform<glm::vec3> uniform, const glm::vec3& value) const
+{
+	if (uniform.isValid())
+		glUniform3fv(uniform.location, 1, &value[0]);
+}
+
+void Shader::set(ShaderUniform<glm::vec4> uniform, const glm::vec4& value) const
+{
+	if (uniform.isValid())
+		glUniform4fv(uniform.location, 1, &value[0]);
+}
+
+void Shader::set(ShaderUniform<glm::mat2> uniform, const glm::mat2& mat) const
+{
+	if (uniform.isValid())
+		glUniformMatrix2fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
+}
+
+void Shader::set(ShaderUniform<glm::mat3> uniform, const glm::mat3& mat) const
+{
+	if (uniform.isValid())
+		glUniformMatrix3fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
+}
+
+void Shader::set(ShaderUniform<glm::mat4> uniform, const glm::mat4& mat) const
+{
+	if (uniform.isValid())
+		glUniformMatrix4fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
 }
 
 void Shader::use()
@@ -97,65 +390,81 @@ void Shader::use()
 
 void Shader::setBool(const std::string& name, bool value) const
 {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+	setBool(ShaderNameHash(name.c_str()), value);
 }
 
 void Shader::setInt(const std::string& name, int value) const
 {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+	setInt(ShaderNameHash(name.c_str()), value);
 }
 
 void Shader::setFloat(const std::string& name, float value) const
 {
-	glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+	setFloat(ShaderNameHash(name.c_str()), value);
 }
 
 void Shader::setVec2(const std::string& name, const glm::vec2& value) const
 {
-	glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+	setVec2(ShaderNameHash(name.c_str()), value);
 }
 
 void Shader::setVec2(const std::string& name, float x, float y) const
 {
-	glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+	setVec2(ShaderNameHash(name.c_str()), glm::vec2(x, y));
 }
 
 void Shader::setVec3(const std::string& name, const glm::vec3& value) const
 {
-	glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+	setVec3(ShaderNameHash(name.c_str()), value);
 }
 
 void Shader::setVec3(const std::string& name, float x, float y, float z) const
 {
-	glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+	setVec3(ShaderNameHash(name.c_str()), glm::vec3(x, y, z));
 }
 
 void Shader::setVec4(const std::string& name, const glm::vec4& value) const
 {
-	glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+	setVec4(ShaderNameHash(name.c_str()), value);
 }
 
 void Shader::setVec4(const std::string& name, float x, float y, float z, float w) const
 {
-	glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+	setVec4(ShaderNameHash(name.c_str()), glm::vec4(x, y, z, w));
 }
 
 void Shader::setMat2(const std::string& name, const glm::mat2& mat) const
 {
-	glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+	setMat2(ShaderNameHash(name.c_str()), mat);
 }
 
 void Shader::setMat3(const std::string& name, const glm::mat3& mat) const
 {
-	glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+	setMat3(ShaderNameHash(name.c_str()), mat);
 }
 
-void Shader::setMat4(const std::string& name, const glm::mat4& mat) const 
+void Shader::setMat4(const std::string& name, const glm::mat4& mat) const
 {
-	glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+	setMat4(ShaderNameHash(name.c_str()), mat);
+}
+
+unsigned int Shader::getActiveAttributeMask() const
+{
+	unsigned int mask = 0;
+	for (const Variable& attribute : m_Attributes)
+	{
+		// Matrices take one location per column
+		int columns = attribute.type == GL_FLOAT_MAT4 ? 4 : attribute.type == GL_FLOAT_MAT3 ? 3 : attribute.type == GL_FLOAT_MAT2 ? 2 : 1;
+		for (int column = 0; column < columns; column++)
+		{
+			if (attribute.location + column < 32)
+				mask |= 1u << (attribute.location + column);
+		}
+	}
+	return mask;
 }
 
-void Shader::checkCompileErrors(unsigned int shader, std::string type)
+bool Shader::checkCompileErrors(unsigned int shader, std::string type)
 {
 	int success;
 	char infoLog[1024];
@@ -177,4 +486,5 @@ void Shader::checkCompileErrors(unsigned int shader, std::string type)
 			std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
 		}
 	}
+	return success != 0;
 }
\ No newline at end of file